@@ -1,11 +1,33 @@
 #include "VideoFrame.h"
 #include "WatermarkReference.h"
 #include "Detector.h"
+#include "ReferenceStore.h"
 
 #include <boost/program_options.hpp>
 
 #include <iostream>
+#include <thread>
 
+namespace
+{
+	bool isStore(const std::string& fileName)
+	{
+		return fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".wrs") == 0;
+	}
+
+	// references in a .wrs store are mapped instead of decoded
+	std::shared_ptr<VideoFrame> openReference(const std::string& fileName, uint64_t key, std::size_t width, std::size_t height)
+	{
+		if (!isStore(fileName))
+			return std::make_shared<VideoFrame>(fileName, VideoFrame::Grayscale);
+
+		ReferenceStore store;
+		if (!store.open(fileName))
+			return nullptr;
+
+		return store.find(key, width, height);
+	}
+}
 
 int main(int argc, char** argv)
 {
@@ -24,7 +46,8 @@ int main(int argc, char** argv)
 		("value,v", po::value<bool>()->default_value(true), "embedded value")
 		("in,i", po::value<std::string>(), "input file")
 		("out,o", po::value<std::string>(), "output file")
-		("reference,r", po::value<std::string>(), "reference file")
+		("reference,r", po::value<std::string>(), "reference file (.wrs files are reference stores, generated references are added to them)")
+		("key", po::value<uint64_t>()->default_value(0), "key of the reference in a reference store, also seeds the reference generation")
 		;
 
 	po::variables_map vm;
@@ -45,10 +68,14 @@ int main(int argc, char** argv)
 			return 1;
 		}
 
-		auto preference = WR::createRandom(pframe->width(), pframe->height(), vm["reference_max"].as<int>(), VideoFrame::Grayscale);
-
-		preference->DCTSharpening(vm["robustness_threshold"].as<double>(), vm["reference_max"].as<int>());
-		preference->save(vm["out"].as<std::string>());
+		// the key seeds both the pattern and the sharpening, so a key always gives the same reference
+		ThreadPool threadPool(std::thread::hardware_concurrency());
+		auto preference = WR::createRandom(pframe->width(), pframe->height(), vm["reference_max"].as<int>(), vm["key"].as<uint64_t>(), threadPool, VideoFrame::Grayscale);
+		preference->DCTSharpening(vm["robustness_threshold"].as<double>(), vm["reference_max"].as<int>(), vm["key"].as<uint64_t>(), threadPool);
+		if (isStore(vm["out"].as<std::string>()))
+			ReferenceStore::merge(vm["out"].as<std::string>(), { { vm["key"].as<uint64_t>(), preference } });
+		else
+			preference->save(vm["out"].as<std::string>());
 
 /*		std::vector<float> dctData = preference->fDCT();
 		float threshold = vm["robustness_threshold"].as<double>();
@@ -82,7 +109,7 @@ int main(int argc, char** argv)
 			return 1;
 		}
 
-		std::shared_ptr<VideoFrame> preference = std::make_shared<VideoFrame>(vm["reference"].as<std::string>(), VideoFrame::Grayscale);
+		std::shared_ptr<VideoFrame> preference = openReference(vm["reference"].as<std::string>(), vm["key"].as<uint64_t>(), pframe->width(), pframe->height());
 		if (!preference)
 		{
 			std::cout << "Error opening reference file `" + vm["reference"].as<std::string>() + "`";
@@ -100,14 +127,14 @@ int main(int argc, char** argv)
 			return 1;
 		}
 
-		std::shared_ptr<VideoFrame> pframe = std::make_shared<VideoFrame>(vm["in"].as<std::string>());
+		std::shared_ptr<VideoFrame> pframe = std::make_shared<VideoFrame>(vm["in"].as<std::string>(), VideoFrame::Grayscale);
 		if (!pframe)
 		{
 			std::cout << "Error opening input file `" + vm["in"].as<std::string>() + "`";
 			return 1;
 		}
 
-		std::shared_ptr<VideoFrame> preference = std::make_shared<VideoFrame>(vm["reference"].as<std::string>());
+		std::shared_ptr<VideoFrame> preference = openReference(vm["reference"].as<std::string>(), vm["key"].as<uint64_t>(), pframe->width(), pframe->height());
 		if (!preference)
 		{
 			std::cout << "Error opening reference file `" + vm["reference"].as<std::string>() + "`";
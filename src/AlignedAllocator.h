@@ -0,0 +1,97 @@
+#ifndef ALIGNED_ALLOCATOR_H_
+#define ALIGNED_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Allocator returning memory aligned to the widest SIMD register (or a cache line).
+template <typename T, std::size_t Alignment = 64>
+class AlignedAllocator
+{
+public:
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind
+  {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&)
+  {
+  }
+
+  T* allocate(std::size_t count)
+  {
+    if (count == 0)
+      return nullptr;
+
+    std::size_t size = (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+#ifdef _MSC_VER
+    void* ptr = _aligned_malloc(size, Alignment);
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, Alignment, size) != 0)
+      ptr = nullptr;
+#endif
+    if (!ptr)
+      throw std::bad_alloc();
+
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, std::size_t)
+  {
+#ifdef _MSC_VER
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+
+  // default-initialize, so growing a buffer does not touch (and fault in) memory that is about to be overwritten
+  template <typename U>
+  void construct(U* ptr)
+  {
+    ::new (static_cast<void*>(ptr)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U* ptr, Args&&... args)
+  {
+    ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment>&) const
+  {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment>&) const
+  {
+    return false;
+  }
+};
+
+typedef std::vector<uint8_t, AlignedAllocator<uint8_t>> AlignedBuffer;
+
+// Row size in bytes padded so every row starts on a 64-byte boundary.
+inline std::size_t alignedStride(std::size_t rowBytes)
+{
+  return (rowBytes + 63) / 64 * 64;
+}
+
+#endif
@@ -0,0 +1,197 @@
+#include "AutoTuner.h"
+
+#include <chrono>
+#include <fstream>
+#include <limits>
+
+namespace
+{
+  const int measurements = 3;
+
+  // best of several runs after a warm-up run, in microseconds
+  std::size_t measure(VideoFrame& frame, std::shared_ptr<VideoFrame> preference, ThreadPool& threadPool, const VideoFrame::Plan& plan)
+  {
+    frame.applyWR(preference, 1.0, true, threadPool, plan);
+
+    std::size_t best = std::numeric_limits<std::size_t>::max();
+    for (int i = 0; i < measurements; i++)
+    {
+      auto start = std::chrono::steady_clock::now();
+      frame.applyWR(preference, 1.0, i % 2 == 0, threadPool, plan);
+      auto stop = std::chrono::steady_clock::now();
+
+      best = std::min<std::size_t>(best, std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count());
+    }
+    return best;
+  }
+}
+
+AutoTuner& AutoTuner::instance()
+{
+  static AutoTuner tuner;
+  return tuner;
+}
+
+VideoFrame::Plan AutoTuner::plan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, ThreadPool& threadPool)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  Key key(width, height, colorFormat, threadPool.size());
+  auto it = m_plans.find(key);
+  if (it != m_plans.end())
+    return it->second;
+
+  // concurrent first requests for the geometry wait for the one measuring it
+  auto pending = m_pending.find(key);
+  if (pending != m_pending.end())
+  {
+    std::shared_future<VideoFrame::Plan> future = pending->second;
+    lock.unlock();
+    return future.get();
+  }
+
+  // tuning runs without the lock, so other geometries and known plans are not held up
+  std::promise<VideoFrame::Plan> promise;
+  m_pending[key] = promise.get_future().share();
+  lock.unlock();
+
+  VideoFrame::Plan plan;
+  try
+  {
+    plan = tune(width, height, colorFormat, threadPool);
+  }
+  catch (...)
+  {
+    lock.lock();
+    m_pending.erase(key);
+    lock.unlock();
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  lock.lock();
+  m_plans[key] = plan;
+  m_pending.erase(key);
+  lock.unlock();
+  promise.set_value(plan);
+  return plan;
+}
+
+void AutoTuner::setPlan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, std::size_t poolSize, const VideoFrame::Plan& plan)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_plans[Key(width, height, colorFormat, poolSize)] = plan;
+}
+
+bool AutoTuner::hasPlan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, std::size_t poolSize) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_plans.count(Key(width, height, colorFormat, poolSize)) != 0;
+}
+
+bool AutoTuner::findPlan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, std::size_t poolSize, VideoFrame::Plan& plan) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto it = m_plans.find(Key(width, height, colorFormat, poolSize));
+  if (it == m_plans.end())
+    return false;
+
+  plan = it->second;
+  return true;
+}
+
+void AutoTuner::clear()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_plans.clear();
+}
+
+bool AutoTuner::load(const std::string& fileName)
+{
+  std::ifstream stream(fileName);
+  if (!stream)
+    return false;
+
+  std::map<Key, VideoFrame::Plan> plans;
+  std::size_t width, height, poolSize, threads;
+  int format, optimization, threading;
+  while (stream >> width >> height >> format >> poolSize >> optimization >> threading >> threads)
+  {
+    if (format < VideoFrame::Color || format > VideoFrame::NV12 ||
+        optimization < VideoFrame::Auto || optimization > VideoFrame::AVX512 ||
+        threading < VideoFrame::Rows || threading > VideoFrame::Adaptive || threads == 0)
+      return false;
+
+    // a profile written on another machine may name an instruction set this CPU lacks
+    VideoFrame::Plan plan = { VideoFrame::resolveOptimization((VideoFrame::Optimization)optimization), (VideoFrame::ThreadingType)threading, threads };
+    plans[Key(width, height, format, poolSize)] = plan;
+  }
+
+  if (!stream.eof())
+    return false;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (auto& plan : plans)
+    m_plans[plan.first] = plan.second;
+  return true;
+}
+
+bool AutoTuner::save(const std::string& fileName) const
+{
+  std::ofstream stream(fileName);
+  if (!stream)
+    return false;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (auto& plan : m_plans)
+  {
+    stream << std::get<0>(plan.first) << " " << std::get<1>(plan.first) << " " << std::get<2>(plan.first) << " " << std::get<3>(plan.first) << " "
+           << plan.second.optimization << " " << plan.second.threading << " " << plan.second.threads << std::endl;
+  }
+  return (bool)stream;
+}
+
+VideoFrame::Plan AutoTuner::tune(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, ThreadPool& threadPool)
+{
+  VideoFrame::Plan best = { VideoFrame::resolveOptimization(VideoFrame::Auto), VideoFrame::Rows, 1 };
+  if (width == 0 || height == 0)
+    return best;
+
+  VideoFrame frame(width, height, colorFormat);
+  auto preference = std::make_shared<VideoFrame>(width, height, colorFormat);
+
+  // the instruction set is chosen single threaded, wider is not always faster
+  // when the frame does not fit into the caches or the cores downclock
+  std::size_t bestTime = std::numeric_limits<std::size_t>::max();
+  for (VideoFrame::Optimization optimization : { VideoFrame::C, VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+  {
+    if (VideoFrame::resolveOptimization(optimization) != optimization)
+      continue;
+
+    VideoFrame::Plan candidate = { optimization, VideoFrame::Rows, 1 };
+    std::size_t time = measure(frame, preference, threadPool, candidate);
+    if (time < bestTime)
+    {
+      best = candidate;
+      bestTime = time;
+    }
+  }
+
+  // then the partitioning, doubling the partitions up to all participants
+  std::size_t participants = threadPool.size() + 1;
+  for (std::size_t threads = 2; threads < participants * 2; threads *= 2)
+  {
+    threads = std::min(threads, participants);
+    for (VideoFrame::ThreadingType threading : { VideoFrame::Rows, VideoFrame::Collumns, VideoFrame::Tiles })
+    {
+      VideoFrame::Plan candidate = { best.optimization, threading, threads };
+      std::size_t time = measure(frame, preference, threadPool, candidate);
+      if (time < bestTime)
+      {
+        best = candidate;
+        bestTime = time;
+      }
+    }
+  }
+
+  return best;
+}
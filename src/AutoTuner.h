@@ -0,0 +1,47 @@
+#ifndef AUTO_TUNER_H_
+#define AUTO_TUNER_H_
+
+#include <cstddef>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "VideoFrame.h"
+
+// Picks the fastest embedding configuration for a frame geometry and pool size.
+// The first plan() for a geometry times the candidate configurations on
+// scratch frames; the winner is cached and can be saved to a profile file so
+// later runs skip the measurement. Only the Adaptive threading type measures,
+// Auto alone uses plans that are already known, see VideoFrame::resolvePlan.
+// A geometry is measured once; concurrent requests for it wait, requests for
+// other geometries do not.
+class AutoTuner
+{
+public:
+  static AutoTuner& instance();
+
+  // a pool without workers only tunes the instruction set
+  VideoFrame::Plan plan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, ThreadPool& threadPool);
+  void setPlan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, std::size_t poolSize, const VideoFrame::Plan& plan);
+  bool hasPlan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, std::size_t poolSize) const;
+  // the cached plan without tuning, false if there is none
+  bool findPlan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, std::size_t poolSize, VideoFrame::Plan& plan) const;
+  void clear();
+
+  // one plan per line: width height format poolSize optimization threading threads
+  bool load(const std::string& fileName);
+  bool save(const std::string& fileName) const;
+
+private:
+  typedef std::tuple<std::size_t, std::size_t, int, std::size_t> Key;
+
+  VideoFrame::Plan tune(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, ThreadPool& threadPool);
+
+  std::map<Key, VideoFrame::Plan> m_plans;
+  std::map<Key, std::shared_future<VideoFrame::Plan>> m_pending;  //geometries being tuned
+  mutable std::mutex              m_mutex;
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "CompactKernels.h"
+
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  void unpack6_C(const uint8_t* psrc, uint8_t* pdst, std::size_t count)
+  {
+    for (std::size_t i = 0; i < count; i += 4, psrc += 3)
+    {
+      uint32_t group = psrc[0] | (psrc[1] << 8) | (psrc[2] << 16);
+      for (std::size_t k = 0; k < 4 && i + k < count; k++)
+        pdst[i + k] = (group >> (6 * k)) & 0x3F;
+    }
+  }
+
+  void unpackSigns_C(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t amplitude)
+  {
+    for (std::size_t i = 0; i < count; i++)
+      pdst[i] = (psrc[i / 8] >> (i % 8)) & 1 ? amplitude : 0;
+  }
+
+#ifdef CPU_X86
+  // A shuffle moves each 3 byte group into a 32-bit lane, then the four values
+  // of a lane are shifted into its four bytes.
+
+  CPU_TARGET("sse4.1")
+  inline __m128i spread6_SSE(__m128i groups)
+  {
+    const __m128i mask = _mm_set1_epi32(0x3F);
+    __m128i res = _mm_and_si128(groups, mask);
+    res = _mm_or_si128(res, _mm_and_si128(_mm_slli_epi32(groups, 2), _mm_slli_epi32(mask, 8)));
+    res = _mm_or_si128(res, _mm_and_si128(_mm_slli_epi32(groups, 4), _mm_slli_epi32(mask, 16)));
+    res = _mm_or_si128(res, _mm_and_si128(_mm_slli_epi32(groups, 6), _mm_slli_epi32(mask, 24)));
+    return res;
+  }
+
+  CPU_TARGET("sse4.1")
+  void unpack6_SSE(const uint8_t* psrc, uint8_t* pdst, std::size_t count)
+  {
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16, psrc += 12)
+      _mm_storeu_si128((__m128i*)(pdst + i), spread6_SSE(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)psrc), shuffle)));
+
+    unpack6_C(psrc, pdst + i, count - i);
+  }
+
+  CPU_TARGET("sse4.1")
+  void unpackSigns_SSE(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t amplitude)
+  {
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bits = _mm_set1_epi64x((long long)0x8040201008040201ull);
+    const __m128i value = _mm_set1_epi8((char)amplitude);
+
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+      uint16_t word;
+      std::memcpy(&word, psrc + i / 8, sizeof(word));
+      __m128i bytes = _mm_shuffle_epi8(_mm_cvtsi32_si128(word), spread);
+      __m128i set = _mm_cmpeq_epi8(_mm_and_si128(bytes, bits), bits);
+      _mm_storeu_si128((__m128i*)(pdst + i), _mm_and_si128(set, value));
+    }
+
+    unpackSigns_C(psrc + i / 8, pdst + i, count - i, amplitude);
+  }
+
+  CPU_TARGET("avx2")
+  inline __m256i spread6_AVX(__m256i groups)
+  {
+    const __m256i mask = _mm256_set1_epi32(0x3F);
+    __m256i res = _mm256_and_si256(groups, mask);
+    res = _mm256_or_si256(res, _mm256_and_si256(_mm256_slli_epi32(groups, 2), _mm256_slli_epi32(mask, 8)));
+    res = _mm256_or_si256(res, _mm256_and_si256(_mm256_slli_epi32(groups, 4), _mm256_slli_epi32(mask, 16)));
+    res = _mm256_or_si256(res, _mm256_and_si256(_mm256_slli_epi32(groups, 6), _mm256_slli_epi32(mask, 24)));
+    return res;
+  }
+
+  // the shuffles work within 128-bit lanes, so every lane gets its own 12 bytes
+  CPU_TARGET("avx2")
+  void unpack6_AVX(const uint8_t* psrc, uint8_t* pdst, std::size_t count)
+  {
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                             0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    std::size_t i = 0;
+    for (; i + 32 <= count; i += 32, psrc += 24)
+    {
+      __m256i packed = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)psrc)), _mm_loadu_si128((const __m128i*)(psrc + 12)), 1);
+      _mm256_storeu_si256((__m256i*)(pdst + i), spread6_AVX(_mm256_shuffle_epi8(packed, shuffle)));
+    }
+
+    unpack6_C(psrc, pdst + i, count - i);
+  }
+
+  CPU_TARGET("avx2")
+  void unpackSigns_AVX(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t amplitude)
+  {
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_set1_epi64x((long long)0x8040201008040201ull);
+    const __m256i value = _mm256_set1_epi8((char)amplitude);
+
+    std::size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+      uint32_t word;
+      std::memcpy(&word, psrc + i / 8, sizeof(word));
+      __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32((int)word), spread);
+      __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits);
+      _mm256_storeu_si256((__m256i*)(pdst + i), _mm256_and_si256(set, value));
+    }
+
+    unpackSigns_C(psrc + i / 8, pdst + i, count - i, amplitude);
+  }
+
+  CPU_TARGET("avx512f,avx512bw")
+  inline __m512i spread6_AVX512(__m512i groups)
+  {
+    const __m512i mask = _mm512_set1_epi32(0x3F);
+    __m512i res = _mm512_and_si512(groups, mask);
+    res = _mm512_or_si512(res, _mm512_and_si512(_mm512_slli_epi32(groups, 2), _mm512_slli_epi32(mask, 8)));
+    res = _mm512_or_si512(res, _mm512_and_si512(_mm512_slli_epi32(groups, 4), _mm512_slli_epi32(mask, 16)));
+    res = _mm512_or_si512(res, _mm512_and_si512(_mm512_slli_epi32(groups, 6), _mm512_slli_epi32(mask, 24)));
+    return res;
+  }
+
+  CPU_TARGET("avx512f,avx512bw")
+  void unpack6_AVX512(const uint8_t* psrc, uint8_t* pdst, std::size_t count)
+  {
+    const __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+
+    std::size_t i = 0;
+    for (; i + 64 <= count; i += 64, psrc += 48)
+    {
+      __m512i packed = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)psrc));
+      packed = _mm512_inserti32x4(packed, _mm_loadu_si128((const __m128i*)(psrc + 12)), 1);
+      packed = _mm512_inserti32x4(packed, _mm_loadu_si128((const __m128i*)(psrc + 24)), 2);
+      packed = _mm512_inserti32x4(packed, _mm_loadu_si128((const __m128i*)(psrc + 36)), 3);
+      _mm512_storeu_si512((void*)(pdst + i), spread6_AVX512(_mm512_shuffle_epi8(packed, shuffle)));
+    }
+
+    unpack6_C(psrc, pdst + i, count - i);
+  }
+
+  CPU_TARGET("avx512f,avx512bw")
+  void unpackSigns_AVX512(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t amplitude)
+  {
+    const __m512i spread = _mm512_set_epi64(0x0707070707070707ll, 0x0606060606060606ll, 0x0505050505050505ll, 0x0404040404040404ll,
+                                            0x0303030303030303ll, 0x0202020202020202ll, 0x0101010101010101ll, 0x0000000000000000ll);
+    const __m512i bits = _mm512_set1_epi64((long long)0x8040201008040201ull);
+    const __m512i value = _mm512_set1_epi8((char)amplitude);
+
+    std::size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+      uint64_t word;
+      std::memcpy(&word, psrc + i / 8, sizeof(word));
+      // each 128-bit lane holds the whole word, the shuffle picks two bytes per lane
+      __m512i bytes = _mm512_shuffle_epi8(_mm512_set1_epi64((long long)word), spread);
+      __mmask64 set = _mm512_test_epi8_mask(bytes, bits);
+      _mm512_storeu_si512((void*)(pdst + i), _mm512_maskz_mov_epi8(set, value));
+    }
+
+    unpackSigns_C(psrc + i / 8, pdst + i, count - i, amplitude);
+  }
+#endif
+}
+
+void CompactKernels::pack6(const uint8_t* psrc, uint8_t* pdst, std::size_t count)
+{
+  for (std::size_t i = 0; i < count; i += 4, pdst += 3)
+  {
+    uint32_t group = 0;
+    for (std::size_t k = 0; k < 4 && i + k < count; k++)
+      group |= (uint32_t)std::min<uint8_t>(psrc[i + k], 0x3F) << (6 * k);
+
+    pdst[0] = (uint8_t)group;
+    pdst[1] = (uint8_t)(group >> 8);
+    pdst[2] = (uint8_t)(group >> 16);
+  }
+}
+
+void CompactKernels::unpack6(const uint8_t* psrc, uint8_t* pdst, std::size_t count, VideoFrame::Optimization optimization)
+{
+#ifdef CPU_X86
+  if (optimization == VideoFrame::AVX512)
+  {
+    unpack6_AVX512(psrc, pdst, count);
+    return;
+  }
+  else if (optimization == VideoFrame::AVX)
+  {
+    unpack6_AVX(psrc, pdst, count);
+    return;
+  }
+  else if (optimization == VideoFrame::SSE && CpuFeatures::SSE41())
+  {
+    unpack6_SSE(psrc, pdst, count);
+    return;
+  }
+#endif
+  unpack6_C(psrc, pdst, count);
+}
+
+void CompactKernels::packSigns(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t threshold)
+{
+  std::fill(pdst, pdst + (count + 7) / 8, 0);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    if (psrc[i] > threshold)
+      pdst[i / 8] |= 1 << (i % 8);
+  }
+}
+
+void CompactKernels::unpackSigns(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t amplitude, VideoFrame::Optimization optimization)
+{
+#ifdef CPU_X86
+  if (optimization == VideoFrame::AVX512)
+  {
+    unpackSigns_AVX512(psrc, pdst, count, amplitude);
+    return;
+  }
+  else if (optimization == VideoFrame::AVX)
+  {
+    unpackSigns_AVX(psrc, pdst, count, amplitude);
+    return;
+  }
+  else if (optimization == VideoFrame::SSE && CpuFeatures::SSE41())
+  {
+    unpackSigns_SSE(psrc, pdst, count, amplitude);
+    return;
+  }
+#endif
+  unpackSigns_C(psrc, pdst, count, amplitude);
+}
@@ -0,0 +1,24 @@
+#ifndef COMPACT_KERNELS_H_
+#define COMPACT_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "VideoFrame.h"
+
+namespace CompactKernels
+{
+  // Four 6-bit values in 3 bytes, v0 | v1 << 6 | v2 << 12 | v3 << 18 little
+  // endian. Values above 63 saturate.
+  void pack6(const uint8_t* psrc, uint8_t* pdst, std::size_t count);
+  // Reads up to 4 bytes past the packed values.
+  // The optimization must already be resolved with VideoFrame::resolveOptimization.
+  void unpack6(const uint8_t* psrc, uint8_t* pdst, std::size_t count, VideoFrame::Optimization optimization);
+
+  // Bit i % 8 of byte i / 8 is set for values above the threshold
+  void packSigns(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t threshold);
+  // Set bits become amplitude, cleared bits 0
+  void unpackSigns(const uint8_t* psrc, uint8_t* pdst, std::size_t count, uint8_t amplitude, VideoFrame::Optimization optimization);
+};
+
+#endif
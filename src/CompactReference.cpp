@@ -0,0 +1,111 @@
+#include "CompactReference.h"
+
+#include "CompactKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+CompactReference::CompactReference(std::shared_ptr<VideoFrame> preference, Encoding encoding):
+  m_width(preference ? preference->width() : 0),
+  m_height(preference ? preference->height() : 0),
+  m_channels(preference ? preference->channels() : 1),
+  m_colorFormat(preference ? preference->colorFormat() : VideoFrame::Grayscale),
+  m_encoding(encoding),
+  m_amplitude(0),
+  m_stride(0)
+{
+  std::size_t rowValues = m_width * m_channels;
+  std::size_t rowBytes = m_encoding == Packed6 ? (rowValues + 3) / 4 * 3 : (rowValues + 7) / 8;
+
+  // the unpack kernels may read 4 bytes past a row
+  m_stride = alignedStride(rowBytes + 4);
+  m_data.assign(m_stride * m_height, 0);
+
+  if (!preference)
+    return;
+
+  if (m_encoding == Packed6)
+  {
+    for (std::size_t i = 0; i < m_height; i++)
+      CompactKernels::pack6(preference->data(0) + i * preference->stride(0), m_data.data() + i * m_stride, rowValues);
+    return;
+  }
+
+  uint64_t sum = 0;
+  uint64_t sumOfSquares = 0;
+  for (std::size_t i = 0; i < m_height; i++)
+  {
+    const uint8_t* prow = preference->data(0) + i * preference->stride(0);
+    for (std::size_t j = 0; j < rowValues; j++)
+    {
+      sum += prow[j];
+      sumOfSquares += prow[j] * prow[j];
+    }
+  }
+
+  double count = std::max<double>(1, (double)(rowValues * m_height));
+  double mean = sum / count;
+  double deviation = std::sqrt(std::max(0.0, sumOfSquares / count - mean * mean));
+  m_amplitude = (uint8_t)std::min(255.0, std::round(2 * deviation));
+
+  for (std::size_t i = 0; i < m_height; i++)
+    CompactKernels::packSigns(preference->data(0) + i * preference->stride(0), m_data.data() + i * m_stride, rowValues, (uint8_t)mean);
+}
+
+std::size_t CompactReference::width() const
+{
+  return m_width;
+}
+
+std::size_t CompactReference::height() const
+{
+  return m_height;
+}
+
+std::size_t CompactReference::channels() const
+{
+  return m_channels;
+}
+
+VideoFrame::ColorFormat CompactReference::colorFormat() const
+{
+  return m_colorFormat;
+}
+
+CompactReference::Encoding CompactReference::encoding() const
+{
+  return m_encoding;
+}
+
+uint8_t CompactReference::amplitude() const
+{
+  return m_amplitude;
+}
+
+std::size_t CompactReference::stride() const
+{
+  return m_stride;
+}
+
+const uint8_t* CompactReference::data() const
+{
+  return m_data.data();
+}
+
+void CompactReference::decode(uint8_t* pdst, std::size_t row, std::size_t first, std::size_t count, VideoFrame::Optimization optimization) const
+{
+  const uint8_t* prow = m_data.data() + row * m_stride;
+  if (m_encoding == Packed6)
+    CompactKernels::unpack6(prow + first / 4 * 3, pdst, count, optimization);
+  else
+    CompactKernels::unpackSigns(prow + first / 8, pdst, count, m_amplitude, optimization);
+}
+
+std::shared_ptr<VideoFrame> CompactReference::materialize() const
+{
+  auto pframe = std::make_shared<VideoFrame>(m_width, m_height, m_colorFormat);
+  VideoFrame::Optimization optimization = VideoFrame::resolveOptimization(VideoFrame::Auto);
+  for (std::size_t i = 0; i < m_height; i++)
+    decode(pframe->data(0) + i * pframe->stride(0), i, 0, m_width * m_channels, optimization);
+  return pframe;
+}
@@ -0,0 +1,57 @@
+#ifndef COMPACT_REFERENCE_H_
+#define COMPACT_REFERENCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "AlignedAllocator.h"
+#include "VideoFrame.h"
+
+// Watermark reference stored with fewer bits per value. The embed and detect
+// loops unpack it segment by segment with the CompactKernels, so only the
+// packed rows are read from memory.
+class CompactReference
+{
+public:
+  enum Encoding
+  {
+    Packed6, //6 bits per value, exact for references created with a threshold up to 64
+    Sign     //1 bit per value: 0 below the mean, amplitude() above it
+  };
+
+  CompactReference(std::shared_ptr<VideoFrame> preference, Encoding encoding);
+
+  std::size_t width() const;
+  std::size_t height() const;
+  std::size_t channels() const;
+  VideoFrame::ColorFormat colorFormat() const;
+  Encoding encoding() const;
+  // Sign only: twice the standard deviation of the reference, which keeps
+  // the power of the embedded pattern
+  uint8_t amplitude() const;
+
+  // packed bytes of a row
+  std::size_t stride() const;
+  const uint8_t* data() const;
+
+  // Writes `count` values of plane 0 starting at value `first` of row `row`.
+  // first must be a multiple of 64.
+  // The optimization must already be resolved with VideoFrame::resolveOptimization.
+  void decode(uint8_t* pdst, std::size_t row, std::size_t first, std::size_t count, VideoFrame::Optimization optimization) const;
+
+  // the decoded reference stored in a frame
+  std::shared_ptr<VideoFrame> materialize() const;
+
+private:
+  std::size_t             m_width;
+  std::size_t             m_height;
+  std::size_t             m_channels;
+  VideoFrame::ColorFormat m_colorFormat;
+  Encoding                m_encoding;
+  uint8_t                 m_amplitude;
+  std::size_t             m_stride;
+  AlignedBuffer           m_data;
+};
+
+#endif
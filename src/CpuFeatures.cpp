@@ -0,0 +1,74 @@
+#include "CpuFeatures.h"
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+  struct Features
+  {
+    bool sse2 = false;
+    bool sse41 = false;
+    bool avx2 = false;
+    bool avx512bw = false;
+
+    Features()
+    {
+#if defined(CPU_X86) && defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 0);
+      int maxLeaf = info[0];
+
+      __cpuid(info, 1);
+      sse2 = (info[3] & (1 << 26)) != 0;
+      sse41 = (info[2] & (1 << 19)) != 0;
+      bool osxsave = (info[2] & (1 << 27)) != 0;
+      bool avx = (info[2] & (1 << 28)) != 0;
+
+      unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+      bool ymmState = (xcr0 & 0x6) == 0x6;
+      bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+      if (maxLeaf >= 7)
+      {
+        __cpuidex(info, 7, 0);
+        avx2 = avx && ymmState && (info[1] & (1 << 5)) != 0;
+        avx512bw = zmmState && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+      }
+#elif defined(CPU_X86)
+      __builtin_cpu_init();
+      sse2 = __builtin_cpu_supports("sse2");
+      sse41 = __builtin_cpu_supports("sse4.1");
+      avx2 = __builtin_cpu_supports("avx2");
+      avx512bw = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    }
+  };
+
+  const Features& features()
+  {
+    static const Features instance;
+    return instance;
+  }
+}
+
+bool CpuFeatures::SSE2()
+{
+  return features().sse2;
+}
+
+bool CpuFeatures::SSE41()
+{
+  return features().sse41;
+}
+
+bool CpuFeatures::AVX2()
+{
+  return features().avx2;
+}
+
+bool CpuFeatures::AVX512BW()
+{
+  return features().avx512bw;
+}
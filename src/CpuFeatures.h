@@ -0,0 +1,24 @@
+#ifndef CPU_FEATURES_H_
+#define CPU_FEATURES_H_
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_X86 1
+#endif
+
+// Enables an instruction set for a single function, so SIMD kernels can be
+// built without raising the baseline architecture of the whole library.
+#if defined(_MSC_VER)
+#define CPU_TARGET(isa)
+#else
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace CpuFeatures
+{
+  bool SSE2();
+  bool SSE41();
+  bool AVX2();
+  bool AVX512BW();
+};
+
+#endif
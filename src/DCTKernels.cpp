@@ -0,0 +1,244 @@
+#include "DCTKernels.h"
+
+#include "CpuFeatures.h"
+
+#include <cmath>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  const std::size_t N = DCTKernels::blockSize;
+
+  // forward[k][n] = c(k) cos((2n + 1) k pi / 16), the inverse is its transpose
+  struct Basis
+  {
+    float forward[N][N];
+    float inverse[N][N];
+
+    Basis()
+    {
+      const double pi = 3.14159265358979323846;
+      for (std::size_t k = 0; k < N; k++)
+      {
+        double scale = k == 0 ? std::sqrt(1.0 / N) : std::sqrt(2.0 / N);
+        for (std::size_t n = 0; n < N; n++)
+        {
+          forward[k][n] = (float)(scale * std::cos((2 * n + 1) * k * pi / (2 * N)));
+          inverse[n][k] = forward[k][n];
+        }
+      }
+    }
+  };
+
+  const Basis& basis()
+  {
+    static const Basis instance;
+    return instance;
+  }
+
+  // pdst = (m psrc)^T, so two passes give m X m^T
+  void pass_C(const float (&m)[N][N], const float* psrc, float* pdst)
+  {
+    for (std::size_t k = 0; k < N; k++)
+    {
+      for (std::size_t j = 0; j < N; j++)
+      {
+        float acc = m[k][0] * psrc[j];
+        for (std::size_t n = 1; n < N; n++)
+          acc = acc + m[k][n] * psrc[n * N + j];
+        pdst[j * N + k] = acc;
+      }
+    }
+  }
+
+  void transform_C(const float (&m)[N][N], float* pblocks, std::size_t count)
+  {
+    float temp[DCTKernels::blockFloats];
+    for (std::size_t b = 0; b < count; b++, pblocks += DCTKernels::blockFloats)
+    {
+      pass_C(m, pblocks, temp);
+      pass_C(m, temp, pblocks);
+    }
+  }
+
+#ifdef CPU_X86
+  // rows of the block split into a left and a right half
+  CPU_TARGET("sse2")
+  void pass_SSE(const float (&m)[N][N], __m128 (&left)[N], __m128 (&right)[N])
+  {
+    __m128 resLeft[N];
+    __m128 resRight[N];
+    for (std::size_t k = 0; k < N; k++)
+    {
+      __m128 factor = _mm_set1_ps(m[k][0]);
+      __m128 accLeft = _mm_mul_ps(factor, left[0]);
+      __m128 accRight = _mm_mul_ps(factor, right[0]);
+      for (std::size_t n = 1; n < N; n++)
+      {
+        factor = _mm_set1_ps(m[k][n]);
+        accLeft = _mm_add_ps(accLeft, _mm_mul_ps(factor, left[n]));
+        accRight = _mm_add_ps(accRight, _mm_mul_ps(factor, right[n]));
+      }
+      resLeft[k] = accLeft;
+      resRight[k] = accRight;
+    }
+
+    // transpose as four 4x4 quadrants, the off-diagonal ones swap places
+    _MM_TRANSPOSE4_PS(resLeft[0], resLeft[1], resLeft[2], resLeft[3]);
+    _MM_TRANSPOSE4_PS(resRight[0], resRight[1], resRight[2], resRight[3]);
+    _MM_TRANSPOSE4_PS(resLeft[4], resLeft[5], resLeft[6], resLeft[7]);
+    _MM_TRANSPOSE4_PS(resRight[4], resRight[5], resRight[6], resRight[7]);
+    for (std::size_t i = 0; i < 4; i++)
+    {
+      left[i] = resLeft[i];
+      right[i] = resLeft[i + 4];
+      left[i + 4] = resRight[i];
+      right[i + 4] = resRight[i + 4];
+    }
+  }
+
+  CPU_TARGET("sse2")
+  void transform_SSE(const float (&m)[N][N], float* pblocks, std::size_t count)
+  {
+    for (std::size_t b = 0; b < count; b++, pblocks += DCTKernels::blockFloats)
+    {
+      __m128 left[N];
+      __m128 right[N];
+      for (std::size_t i = 0; i < N; i++)
+      {
+        left[i] = _mm_loadu_ps(pblocks + i * N);
+        right[i] = _mm_loadu_ps(pblocks + i * N + 4);
+      }
+
+      pass_SSE(m, left, right);
+      pass_SSE(m, left, right);
+
+      for (std::size_t i = 0; i < N; i++)
+      {
+        _mm_storeu_ps(pblocks + i * N, left[i]);
+        _mm_storeu_ps(pblocks + i * N + 4, right[i]);
+      }
+    }
+  }
+
+  CPU_TARGET("avx2")
+  inline void transpose_AVX(__m256 (&rows)[N])
+  {
+    __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+    __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+    __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+    __m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+    __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+    __m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+  }
+
+  // No FMA, the products are rounded before they are added like in the C version.
+  // Two blocks are interleaved to hide the latency of the additions.
+  CPU_TARGET("avx2")
+  inline void pass_AVX(const float (&m)[N][N], __m256 (&a)[N], __m256 (&b)[N])
+  {
+    __m256 resA[N];
+    __m256 resB[N];
+    for (std::size_t k = 0; k < N; k++)
+    {
+      __m256 factor = _mm256_set1_ps(m[k][0]);
+      __m256 accA = _mm256_mul_ps(factor, a[0]);
+      __m256 accB = _mm256_mul_ps(factor, b[0]);
+      for (std::size_t n = 1; n < N; n++)
+      {
+        factor = _mm256_set1_ps(m[k][n]);
+        accA = _mm256_add_ps(accA, _mm256_mul_ps(factor, a[n]));
+        accB = _mm256_add_ps(accB, _mm256_mul_ps(factor, b[n]));
+      }
+      resA[k] = accA;
+      resB[k] = accB;
+    }
+
+    transpose_AVX(resA);
+    transpose_AVX(resB);
+    for (std::size_t i = 0; i < N; i++)
+    {
+      a[i] = resA[i];
+      b[i] = resB[i];
+    }
+  }
+
+  CPU_TARGET("avx2")
+  void transform_AVX(const float (&m)[N][N], float* pblocks, std::size_t count)
+  {
+    std::size_t b = 0;
+    for (; b + 2 <= count; b += 2, pblocks += 2 * DCTKernels::blockFloats)
+    {
+      __m256 first[N];
+      __m256 second[N];
+      for (std::size_t i = 0; i < N; i++)
+      {
+        first[i] = _mm256_loadu_ps(pblocks + i * N);
+        second[i] = _mm256_loadu_ps(pblocks + DCTKernels::blockFloats + i * N);
+      }
+
+      pass_AVX(m, first, second);
+      pass_AVX(m, first, second);
+
+      for (std::size_t i = 0; i < N; i++)
+      {
+        _mm256_storeu_ps(pblocks + i * N, first[i]);
+        _mm256_storeu_ps(pblocks + DCTKernels::blockFloats + i * N, second[i]);
+      }
+    }
+
+    transform_SSE(m, pblocks, count - b);
+  }
+#endif
+
+  void transform(const float (&m)[N][N], float* pblocks, std::size_t count, VideoFrame::Optimization optimization)
+  {
+#ifdef CPU_X86
+    // the 8 float rows of a block fill AVX registers, AVX512 has no wider form
+    if (optimization == VideoFrame::AVX512 || optimization == VideoFrame::AVX)
+    {
+      transform_AVX(m, pblocks, count);
+      return;
+    }
+    else if (optimization == VideoFrame::SSE)
+    {
+      transform_SSE(m, pblocks, count);
+      return;
+    }
+#endif
+    transform_C(m, pblocks, count);
+  }
+}
+
+void DCTKernels::forward(float* pblocks, std::size_t count, VideoFrame::Optimization optimization)
+{
+  transform(basis().forward, pblocks, count, optimization);
+}
+
+void DCTKernels::inverse(float* pblocks, std::size_t count, VideoFrame::Optimization optimization)
+{
+  transform(basis().inverse, pblocks, count, optimization);
+}
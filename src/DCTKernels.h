@@ -0,0 +1,25 @@
+#ifndef DCT_KERNELS_H_
+#define DCT_KERNELS_H_
+
+#include <cstddef>
+
+#include "VideoFrame.h"
+
+namespace DCTKernels
+{
+  const std::size_t blockSize = 8;
+  const std::size_t blockFloats = blockSize * blockSize;
+
+  // Orthonormal 2D DCT-II (forward) and DCT-III (inverse) in place on count
+  // consecutive 8x8 blocks of row major floats, the transforms cv::dct and
+  // cv::idct compute for an 8x8 matrix. Both passes multiply by the basis
+  // matrix with the rows of a block held in vector registers. Every
+  // optimization rounds and adds the products in the same order, so the
+  // results are bit identical unless the compiler fuses the multiply-adds of
+  // the C version.
+  // The optimization must already be resolved with VideoFrame::resolveOptimization.
+  void forward(float* pblocks, std::size_t count, VideoFrame::Optimization optimization);
+  void inverse(float* pblocks, std::size_t count, VideoFrame::Optimization optimization);
+};
+
+#endif
@@ -1,82 +1,610 @@
 #include "Detector.h"
-#include "VideoFrame.h"
+#include "DetectorKernels.h"
+#include "PreparedReference.h"
+#include "ProceduralReference.h"
+#include "TiledReference.h"
+#include "CompactReference.h"
+#include "ReferenceSegments.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
-Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold)
+#include <opencv2/opencv.hpp>
+
+namespace
+{
+  Detector::Result decide(double corr, double threshold)
+  {
+    Detector::Result res = Detector::NO_WATERMARK;
+    if (corr < -threshold)
+      res = Detector::FALSE;
+    else if (corr > threshold)
+      res = Detector::TRUE;
+
+    return res;
+  }
+
+  // The plane is cut into row blocks that depend only on the geometry. Each
+  // block gets its own partial moments and the partials are added in block
+  // order, so the result does not depend on the pool size.
+  typedef void (*AccumulateKernel)(const uint8_t*, std::size_t, const uint8_t*, std::size_t, std::size_t, std::size_t, Detector::Moments&, VideoFrame::Optimization);
+
+  void accumulateTasks(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t rowBytes, std::size_t height, Detector::Moments& moments, ThreadPool& threadPool, VideoFrame::Optimization optimization, AccumulateKernel kernel = DetectorKernels::accumulate)
+  {
+    optimization = VideoFrame::resolveOptimization(optimization);
+
+    const std::size_t blockBytes = 256 * 1024;
+    std::size_t blockRows = std::max<std::size_t>(1, blockBytes / std::max<std::size_t>(1, rowBytes));
+    std::size_t blocks = (height + blockRows - 1) / blockRows;
+
+    if (threadPool.size() == 0 || blocks <= 1)
+    {
+      kernel(pdata, stride, pnoise, strideNoise, rowBytes, height, moments, optimization);
+      return;
+    }
+
+    std::vector<Detector::Moments> partials(blocks, Detector::Moments(moments.channels));
+    threadPool.parallel_for(0, blocks, 1, [&](std::size_t first, std::size_t last)
+    {
+      for (std::size_t block = first; block < last; block++)
+      {
+        std::size_t row = block * blockRows;
+        std::size_t rows = std::min(blockRows, height - row);
+        kernel(pdata + row * stride, stride, pnoise + row * strideNoise, strideNoise, rowBytes, rows, partials[block], optimization);
+      }
+    });
+
+    for (auto& partial : partials)
+      moments += partial;
+  }
+
+  std::size_t gcd(std::size_t a, std::size_t b)
+  {
+    while (b != 0)
+    {
+      std::size_t t = a % b;
+      a = b;
+      b = t;
+    }
+    return a;
+  }
+
+  // Decides from a partial correlation once its confidence interval fits into
+  // one band, using the Fisher transform with n samples per channel
+  bool decideEarly(double corr, double n, double threshold, double z, Detector::Result& result)
+  {
+    if (n <= 3 || !(std::fabs(corr) < 1))
+      return false;
+
+    double center = std::atanh(corr);
+    double margin = z / std::sqrt(n - 3);
+    double lower = std::tanh(center - margin);
+    double upper = std::tanh(center + margin);
+
+    if (lower > threshold)
+      result = Detector::TRUE;
+    else if (upper < -threshold)
+      result = Detector::FALSE;
+    else if (lower > -threshold && upper < threshold)
+      result = Detector::NO_WATERMARK;
+    else
+      return false;
+
+    return true;
+  }
+
+  // Normal quantile of a two-sided interval whose error rate is that of z
+  // divided by `looks` (Bonferroni), found by bisection on erfc
+  double correctedQuantile(double z, std::size_t looks)
+  {
+    double alpha = std::erfc(z / std::sqrt(2.0)) / (double)std::max<std::size_t>(1, looks);
+    double lower = z, upper = z + 10;
+    for (int i = 0; i < 64; i++)
+    {
+      double middle = (lower + upper) / 2;
+      if (std::erfc(middle / std::sqrt(2.0)) > alpha)
+        lower = middle;
+      else
+        upper = middle;
+    }
+    return upper;
+  }
+
+  // Moments of one row block against every reference. The frame block stays in
+  // cache while the references stream past it, and its own sums are taken once.
+  void accumulateReferences(const VideoFrame& frame, const std::vector<std::shared_ptr<VideoFrame>>& references, std::size_t row, std::size_t rows, std::vector<Detector::Moments>& moments, VideoFrame::Optimization optimization)
+  {
+    std::size_t rowBytes = frame.width() * frame.channels();
+    const uint8_t* pdata = frame.data(0) + row * frame.stride(0);
+
+    for (std::size_t reference = 0; reference < references.size(); reference++)
+    {
+      const VideoFrame& noise = *references[reference];
+      const uint8_t* pnoise = noise.data(0) + row * noise.stride(0);
+      if (reference == 0)
+        DetectorKernels::accumulate(pdata, frame.stride(0), pnoise, noise.stride(0), rowBytes, rows, moments[0], optimization);
+      else
+        DetectorKernels::accumulateReference(pdata, frame.stride(0), pnoise, noise.stride(0), rowBytes, rows, moments[reference], optimization);
+    }
+  }
+
+  using ReferenceSegments::segmentBytes;
+  using ReferenceSegments::fillSegment;
+
+  template <typename Reference>
+  void accumulateSegments(const VideoFrame& frame, const Reference& reference, std::size_t first, std::size_t last, Detector::Moments& moments, VideoFrame::Optimization optimization)
+  {
+    alignas(64) uint8_t tile[segmentBytes];
+    std::size_t rowBytes = frame.width() * frame.channels();
+    for (std::size_t row = first; row < last; row++)
+    {
+      const uint8_t* pdata = frame.data(0) + row * frame.stride(0);
+      for (std::size_t column = 0; column < rowBytes; column += segmentBytes)
+      {
+        std::size_t bytes = std::min(segmentBytes, rowBytes - column);
+        fillSegment(reference, tile, row, column, bytes, optimization);
+        DetectorKernels::accumulate(pdata + column, 0, tile, 0, bytes, 1, moments, optimization);
+      }
+    }
+  }
+
+  // fixed row blocks with partials added in block order, as in accumulateTasks
+  template <typename Reference>
+  Detector::Result correlateSegments(const VideoFrame& frame, const Reference& reference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+  {
+    if (frame.width() != reference.width() || frame.height() != reference.height() || frame.channels() != reference.channels())
+      return Detector::FAILED;
+
+    optimization = VideoFrame::resolveOptimization(optimization);
+
+    const std::size_t blockBytes = 64 * 1024;
+    std::size_t rowBytes = frame.width() * frame.channels();
+    std::size_t height = frame.height();
+    std::size_t blockRows = std::max<std::size_t>(1, blockBytes / std::max<std::size_t>(1, rowBytes));
+    std::size_t blocks = (height + blockRows - 1) / blockRows;
+
+    std::vector<Detector::Moments> partials(blocks, Detector::Moments(frame.channels()));
+    threadPool.parallel_for(0, blocks, 1, [&](std::size_t first, std::size_t last)
+    {
+      for (std::size_t block = first; block < last; block++)
+        accumulateSegments(frame, reference, block * blockRows, std::min(height, (block + 1) * blockRows), partials[block], optimization);
+    });
+
+    Detector::Moments moments(frame.channels());
+    for (auto& partial : partials)
+      moments += partial;
+
+    return decide(Detector::correlation(moments), threshold);
+  }
+
+  // rows in bands that do not wrap around the tile, segments start at tile column 0
+  void accumulateTiled(const VideoFrame& frame, const TiledReference& reference, std::size_t first, std::size_t last, Detector::Moments& moments, VideoFrame::Optimization optimization)
+  {
+    std::size_t rowBytes = frame.width() * frame.channels();
+    for (std::size_t row = first; row < last; )
+    {
+      std::size_t rows = std::min(last - row, reference.height() - row % reference.height());
+      for (std::size_t column = 0; column < rowBytes; column += reference.segmentBytes())
+        DetectorKernels::accumulate(frame.data(0) + row * frame.stride(0) + column, frame.stride(0), reference.row(row), reference.stride(), std::min(reference.segmentBytes(), rowBytes - column), rows, moments, optimization);
+      row += rows;
+    }
+  }
+
+  // Spectrum of one channel of plane 0 with its mean removed, zero padded to
+  // rows x cols so that the circular correlation does not wrap
+  cv::Mat centeredSpectrum(const VideoFrame& frame, std::size_t channel, int rows, int cols)
+  {
+    std::size_t channels = frame.channels();
+    std::size_t width = frame.width();
+    std::size_t height = frame.height();
+
+    uint64_t sum = 0;
+    for (std::size_t y = 0; y < height; y++)
+    {
+      const uint8_t* prow = frame.data(0) + y * frame.stride(0) + channel;
+      for (std::size_t x = 0; x < width; x++)
+        sum += prow[x * channels];
+    }
+    float mean = (float)((double)sum / (double)(width * height));
+
+    cv::Mat plane = cv::Mat::zeros(rows, cols, CV_32F);
+    for (std::size_t y = 0; y < height; y++)
+    {
+      const uint8_t* prow = frame.data(0) + y * frame.stride(0) + channel;
+      float* pplane = plane.ptr<float>((int)y);
+      for (std::size_t x = 0; x < width; x++)
+        pplane[x] = prow[x * channels] - mean;
+    }
+
+    cv::Mat spectrum;
+    cv::dft(plane, spectrum, cv::DFT_COMPLEX_OUTPUT);
+    return spectrum;
+  }
+}
+
+Detector::Moments::Moments(std::size_t channels):
+  channels(channels),
+  count(0),
+  sumF(),
+  sumN(),
+  sumFF(),
+  sumNN(),
+  sumFN()
+{
+}
+
+Detector::Moments& Detector::Moments::operator+=(const Moments& other)
+{
+  count += other.count;
+  for (std::size_t channel = 0; channel < 3; channel++)
+  {
+    sumF[channel] += other.sumF[channel];
+    sumN[channel] += other.sumN[channel];
+    sumFF[channel] += other.sumFF[channel];
+    sumNN[channel] += other.sumNN[channel];
+    sumFN[channel] += other.sumFN[channel];
+  }
+  return *this;
+}
+
+bool Detector::computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, Moments& moments, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return computeMoments(pFrame, pFrameNoise, moments, threadPool, optimization);
+}
+
+bool Detector::computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, Moments& moments, ThreadPool& threadPool, VideoFrame::Optimization optimization)
 {
   if (!pFrame || !pFrameNoise)
+    return false;
+
+  if (pFrame->width() != pFrameNoise->width() || pFrame->height() != pFrameNoise->height() || pFrame->channels() != pFrameNoise->channels())
+    return false;
+
+  moments = Moments(pFrame->channels());
+  accumulateTasks(pFrame->data(0), pFrame->stride(0), pFrameNoise->data(0), pFrameNoise->stride(0), pFrame->width() * moments.channels, pFrame->height(), moments, threadPool, optimization);
+  return true;
+}
+
+bool Detector::computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, Moments& moments, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return computeMoments(pFrame, preference, moments, threadPool, optimization);
+}
+
+bool Detector::computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, Moments& moments, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!pFrame || !preference)
+    return false;
+
+  if (pFrame->width() != preference->width() || pFrame->height() != preference->height() || pFrame->channels() != preference->channels())
+    return false;
+
+  // the reference sums come with the prepared reference, only the frame is summed
+  moments = Moments(preference->channels());
+  accumulateTasks(pFrame->data(0), pFrame->stride(0), preference->data(), preference->stride(), pFrame->width() * moments.channels, pFrame->height(), moments, threadPool, optimization, DetectorKernels::accumulateFrame);
+  for (std::size_t channel = 0; channel < moments.channels; channel++)
+  {
+    moments.sumN[channel] = preference->sum(channel);
+    moments.sumNN[channel] = preference->sumOfSquares(channel);
+  }
+  return true;
+}
+
+double Detector::correlation(const Moments& moments)
+{
+  double count = (double)moments.count;
+  double corr = 0;
+  for (std::size_t channel = 0; channel < moments.channels; channel++)
+  {
+    double sumF = (double)moments.sumF[channel];
+    double sumN = (double)moments.sumN[channel];
+    double num = (double)moments.sumFN[channel] - sumF * sumN / count;
+    double varF = (double)moments.sumFF[channel] - sumF * sumF / count;
+    double varN = (double)moments.sumNN[channel] - sumN * sumN / count;
+
+    corr += num / std::sqrt(varF) / std::sqrt(varN);
+  }
+
+  return corr / moments.channels;
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return LinearCorrelation(pFrame, pFrameNoise, threshold, threadPool, optimization);
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  // 4:2:0 frames carry the watermark in the luma plane only
+  Moments moments;
+  if (!computeMoments(pFrame, pFrameNoise, moments, threadPool, optimization))
+    return Detector::FAILED;
+
+  return decide(correlation(moments), threshold);
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, double threshold, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return LinearCorrelation(pFrame, preference, threshold, threadPool, optimization);
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  Moments moments;
+  if (!computeMoments(pFrame, preference, moments, threadPool, optimization))
     return Detector::FAILED;
 
-  if(pFrame->width() != pFrameNoise->width() || pFrame->height() != pFrameNoise->height())
+  return decide(correlation(moments), threshold);
+}
+
+Detector::Result Detector::CrossCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, Peak* ppeak, VideoFrame::Optimization optimization)
+{
+  if (!pFrame || !pFrameNoise || pFrame->channels() != pFrameNoise->channels())
     return Detector::FAILED;
 
-  uint8_t* pdata = pFrame->data(0);
-  uint8_t* pnoise = pFrameNoise->data(0);
+  int width = (int)pFrame->width();
+  int height = (int)pFrame->height();
+  int widthNoise = (int)pFrameNoise->width();
+  int heightNoise = (int)pFrameNoise->height();
+  if (width == 0 || height == 0 || widthNoise == 0 || heightNoise == 0)
+    return Detector::FAILED;
 
-  std::size_t width = pFrame->width();
-  std::size_t stride = width * 3;
-  std::size_t height = pFrame->height();
-  int result = 0;
+  // every offset with some overlap gets its own cell of the surface
+  int cols = cv::getOptimalDFTSize(width + widthNoise - 1);
+  int rows = cv::getOptimalDFTSize(height + heightNoise - 1);
 
-  double meanRf = 0, meanRn = 0, meanGf = 0, meanGn = 0, meanBf = 0, meanBn = 0;
-  for (int i = 0; i < height; i++)
+  // sum over x of f(x) * n(x + d) is the inverse transform of N * conj(F),
+  // the channels add up in the frequency domain
+  cv::Mat product = cv::Mat::zeros(rows, cols, CV_32FC2);
+  for (std::size_t channel = 0; channel < pFrame->channels(); channel++)
   {
-    for (int j = 0; j < width; j++)
+    cv::Mat spectrum;
+    cv::mulSpectrums(centeredSpectrum(*pFrameNoise, channel, rows, cols), centeredSpectrum(*pFrame, channel, rows, cols), spectrum, 0, true);
+    for (int y = 0; y < rows; y++)
     {
-      meanBf += pdata[i * stride + j * 3];
-      meanBn += pnoise[i * stride + j * 3];
+      const float* psrc = spectrum.ptr<float>(y);
+      float* pdst = product.ptr<float>(y);
+      for (int x = 0; x < 2 * cols; x++)
+        pdst[x] += psrc[x];
+    }
+  }
 
-      meanGf += pdata[i * stride + j * 3 + 1];
-      meanGn += pnoise[i * stride + j * 3 + 1];
+  cv::Mat surface;
+  cv::dft(product, surface, cv::DFT_INVERSE | cv::DFT_REAL_OUTPUT);
 
-      meanRf += pdata[i * stride + j * 3 + 2];
-      meanRn += pnoise[i * stride + j * 3 + 2];
+  // negative offsets wrap around to the end of the surface
+  int dx = 0;
+  int dy = 0;
+  float best = -1;
+  for (int y = 0; y < rows; y++)
+  {
+    int offsetY = y < heightNoise ? y : y - rows;
+    if (offsetY <= -height)
+      continue;
+
+    const float* prow = surface.ptr<float>(y);
+    for (int x = 0; x < cols; x++)
+    {
+      int offsetX = x < widthNoise ? x : x - cols;
+      if (offsetX > -width && std::fabs(prow[x]) > best)
+      {
+        best = std::fabs(prow[x]);
+        dx = offsetX;
+        dy = offsetY;
+      }
     }
   }
 
-  meanBf /= height * width;
-  meanBn /= height * width;
-  meanGf /= height * width;
-  meanGn /= height * width;
-  meanRf /= height * width;
-  meanRn /= height * width;
+  // the peak value is normalized over the overlapping area only
+  int left = std::max(0, -dx);
+  int top = std::max(0, -dy);
+  int right = std::min(width, widthNoise - dx);
+  int bottom = std::min(height, heightNoise - dy);
+  std::size_t channels = pFrame->channels();
+
+  Moments moments(channels);
+  DetectorKernels::accumulate(pFrame->data(0) + top * pFrame->stride(0) + left * channels, pFrame->stride(0),
+                              pFrameNoise->data(0) + (top + dy) * pFrameNoise->stride(0) + (left + dx) * channels, pFrameNoise->stride(0),
+                              (right - left) * channels, bottom - top, moments, VideoFrame::resolveOptimization(optimization));
+
+  double corr = correlation(moments);
+  if (ppeak)
+  {
+    ppeak->dx = dx;
+    ppeak->dy = dy;
+    ppeak->correlation = corr;
+  }
+
+  return decide(corr, threshold);
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<ProceduralReference> preference, double threshold, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return LinearCorrelation(pFrame, preference, threshold, threadPool, optimization);
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<ProceduralReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!pFrame || !preference)
+    return Detector::FAILED;
+
+  return correlateSegments(*pFrame, *preference, threshold, threadPool, optimization);
+}
 
-  double numB = 0, sqrBf = 0, sqrBn = 0;
-  double numG = 0, sqrGf = 0, sqrGn = 0;
-  double numR = 0, sqrRf = 0, sqrRn = 0;
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<CompactReference> preference, double threshold, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return LinearCorrelation(pFrame, preference, threshold, threadPool, optimization);
+}
 
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<CompactReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!pFrame || !preference)
+    return Detector::FAILED;
 
-  for (int i = 0; i < height; i++)
+  return correlateSegments(*pFrame, *preference, threshold, threadPool, optimization);
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<TiledReference> preference, double threshold, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return LinearCorrelation(pFrame, preference, threshold, threadPool, optimization);
+}
+
+Detector::Result Detector::LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<TiledReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!pFrame || !preference || preference->segmentBytes() == 0)
+    return Detector::FAILED;
+
+  if (pFrame->channels() != preference->channels())
+    return Detector::FAILED;
+
+  optimization = VideoFrame::resolveOptimization(optimization);
+
+  // fixed row blocks with partials added in block order, as in accumulateTasks
+  const std::size_t blockBytes = 256 * 1024;
+  std::size_t rowBytes = pFrame->width() * pFrame->channels();
+  std::size_t height = pFrame->height();
+  std::size_t blockRows = std::max<std::size_t>(1, blockBytes / std::max<std::size_t>(1, rowBytes));
+  std::size_t blocks = (height + blockRows - 1) / blockRows;
+
+  std::vector<Moments> partials(blocks, Moments(pFrame->channels()));
+  threadPool.parallel_for(0, blocks, 1, [&](std::size_t first, std::size_t last)
+  {
+    for (std::size_t block = first; block < last; block++)
+      accumulateTiled(*pFrame, *preference, block * blockRows, std::min(height, (block + 1) * blockRows), partials[block], optimization);
+  });
+
+  Moments moments(pFrame->channels());
+  for (auto& partial : partials)
+    moments += partial;
+
+  return decide(correlation(moments), threshold);
+}
+
+std::vector<double> Detector::LinearCorrelations(std::shared_ptr<VideoFrame> pFrame, const std::vector<std::shared_ptr<VideoFrame>>& references, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return LinearCorrelations(pFrame, references, threadPool, optimization);
+}
+
+std::vector<double> Detector::LinearCorrelations(std::shared_ptr<VideoFrame> pFrame, const std::vector<std::shared_ptr<VideoFrame>>& references, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  std::vector<double> correlations;
+  if (!pFrame)
+    return correlations;
+
+  for (auto& preference : references)
   {
-    for (int j = 0; j < width; j++)
+    if (!preference || pFrame->width() != preference->width() || pFrame->height() != preference->height() || pFrame->channels() != preference->channels())
+      return correlations;
+  }
+
+  if (references.empty())
+    return correlations;
+
+  optimization = VideoFrame::resolveOptimization(optimization);
+
+  // blocks of the frame small enough to stay in L2 while all references are read
+  const std::size_t blockBytes = 64 * 1024;
+  std::size_t rowBytes = pFrame->width() * pFrame->channels();
+  std::size_t height = pFrame->height();
+  std::size_t blockRows = std::max<std::size_t>(1, blockBytes / std::max<std::size_t>(1, rowBytes));
+  std::size_t blocks = (height + blockRows - 1) / blockRows;
+
+  std::vector<Moments> moments(references.size(), Moments(pFrame->channels()));
+  if (threadPool.size() == 0)
+  {
+    for (std::size_t block = 0; block < blocks; block++)
+      accumulateReferences(*pFrame, references, block * blockRows, std::min(blockRows, height - block * blockRows), moments, optimization);
+  }
+  else
+  {
+    // per block partials added in block order keep the result independent of the pool size
+    std::vector<std::vector<Moments>> partials(blocks, moments);
+    threadPool.parallel_for(0, blocks, 1, [&](std::size_t first, std::size_t last)
     {
-      numB += ((double)pdata[i * stride + j * 3] - meanBf) * ((double)pnoise[i * stride + j * 3] - meanBn);
-      numG += ((double)pdata[i * stride + j * 3 + 1] - meanGf) * ((double)pnoise[i * stride + j * 3 + 1] - meanGn);
-      numR += ((double)pdata[i * stride + j * 3 + 2] - meanRf) * ((double)pnoise[i * stride + j * 3 + 2] - meanRn);
+      for (std::size_t block = first; block < last; block++)
+        accumulateReferences(*pFrame, references, block * blockRows, std::min(blockRows, height - block * blockRows), partials[block], optimization);
+    });
 
-      sqrBf += std::pow(pdata[i * stride + j * 3] - meanBf, 2);
-      sqrBn += std::pow(pnoise[i * stride + j * 3] - meanBn, 2);
+    for (auto& partial : partials)
+    {
+      for (std::size_t reference = 0; reference < references.size(); reference++)
+        moments[reference] += partial[reference];
+    }
+  }
 
-      sqrGf += std::pow(pdata[i * stride + j * 3 + 1] - meanGf, 2);
-      sqrGn += std::pow(pnoise[i * stride + j * 3 + 1] - meanGn, 2);
+  correlations.resize(references.size());
+  for (std::size_t reference = 0; reference < references.size(); reference++)
+  {
+    std::copy(moments[0].sumF, moments[0].sumF + 3, moments[reference].sumF);
+    std::copy(moments[0].sumFF, moments[0].sumFF + 3, moments[reference].sumFF);
+    correlations[reference] = correlation(moments[reference]);
+  }
+
+  return correlations;
+}
+
+Detector::Result Detector::ProgressiveLinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, double z, Moments* pmoments, VideoFrame::Optimization optimization)
+{
+  if (!pFrame || !pFrameNoise)
+    return Detector::FAILED;
 
-      sqrRf += std::pow(pdata[i * stride + j * 3 + 2] - meanRf, 2);
-      sqrRn += std::pow(pnoise[i * stride + j * 3 + 2] - meanRn, 2);
+  if (pFrame->width() != pFrameNoise->width() || pFrame->height() != pFrameNoise->height() || pFrame->channels() != pFrameNoise->channels())
+    return Detector::FAILED;
+
+  optimization = VideoFrame::resolveOptimization(optimization);
+
+  const std::size_t blockRows = 8;
+  const std::size_t minSamples = 1024;
+  std::size_t rowBytes = pFrame->width() * pFrame->channels();
+  std::size_t height = pFrame->height();
+  std::size_t blocks = (height + blockRows - 1) / blockRows;
+
+  // Blocks are visited with a stride coprime to their number, which spreads the
+  // early samples over the whole frame and still visits every block once.
+  std::size_t step = std::max<std::size_t>(1, (std::size_t)(blocks * 0.618));
+  while (gcd(step, blocks) != 1)
+    step++;
+
+  // The interval is tested once the sample count reaches minSamples, then each
+  // time it has doubled. Splitting the error rate over these looks keeps the
+  // chance that any early decision is wrong within that of a single z interval.
+  std::size_t samples = pFrame->width() * height;
+  std::size_t looks = 0;
+  for (std::size_t look = minSamples; look < samples; look *= 2)
+    looks++;
+  double zLook = correctedQuantile(z, looks);
+
+  Moments moments(pFrame->channels());
+  Result result = Detector::NO_WATERMARK;
+  bool decided = false;
+  std::size_t nextLook = minSamples;
+  for (std::size_t i = 0, block = 0; i < blocks && !decided; i++, block = (block + step) % blocks)
+  {
+    std::size_t row = block * blockRows;
+    std::size_t rows = std::min(blockRows, height - row);
+    DetectorKernels::accumulate(pFrame->data(0) + row * pFrame->stride(0), pFrame->stride(0), pFrameNoise->data(0) + row * pFrameNoise->stride(0), pFrameNoise->stride(0), rowBytes, rows, moments, optimization);
+
+    if (moments.count >= nextLook && i + 1 < blocks)
+    {
+      decided = decideEarly(correlation(moments), (double)moments.count, threshold, zLook, result);
+      while (nextLook <= moments.count)
+        nextLook *= 2;
     }
   }
 
-  double corrB = numB / std::sqrt(sqrBf) / std::sqrt(sqrBn);
-  double corrG = numG / std::sqrt(sqrGf) / std::sqrt(sqrGn);
-  double corrR = numR / std::sqrt(sqrRf) / std::sqrt(sqrRn);
+  if (!decided)
+    result = decide(correlation(moments), threshold);
 
-  double corr = (corrB + corrG + corrR) / 3;
+  if (pmoments)
+    *pmoments = moments;
 
-  Detector::Result res = Detector::NO_WATERMARK;
-  if (corr < -threshold)
-    res = Detector::FALSE;
-  else if(corr > threshold)
-    res = Detector::TRUE;
-   
-  return res;
-}
\ No newline at end of file
+  return result;
+}
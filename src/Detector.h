@@ -1,9 +1,17 @@
 #ifndef DETECTOR_H_
 #define DETECTOR_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
-class VideoFrame;
+#include "VideoFrame.h"
+
+class PreparedReference;
+class ProceduralReference;
+class TiledReference;
+class CompactReference;
 
 namespace Detector
 {
@@ -15,8 +23,83 @@ namespace Detector
     NO_WATERMARK
   };
 
-  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold);
+  // Per channel sums over a frame f and a reference n. The correlation follows
+  // from them without a second pass, and moments of parts of a frame add up.
+  struct Moments
+  {
+    Moments(std::size_t channels = 1);
+    Moments& operator+=(const Moments& other);
+
+    std::size_t channels;
+    uint64_t    count;     //pixels per channel
+    uint64_t    sumF[3];
+    uint64_t    sumN[3];
+    uint64_t    sumFF[3];
+    uint64_t    sumNN[3];
+    uint64_t    sumFN[3];
+  };
+
+  // Sums over the interleaved channels of plane 0 (the luma plane of 4:2:0 frames)
+  bool computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, Moments& moments, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  // The sums are exact integers, so the result is identical for every pool size
+  bool computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, Moments& moments, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  // Uses the reference sums of the prepared reference and sums only the frame
+  bool computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, Moments& moments, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  bool computeMoments(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, Moments& moments, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  // Pearson correlation averaged over the channels
+  double correlation(const Moments& moments);
+
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, double threshold, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<PreparedReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // The reference is regenerated from its key while the frame is read
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<ProceduralReference> preference, double threshold, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<ProceduralReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // The packed reference is unpacked while the frame is read
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<CompactReference> preference, double threshold, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<CompactReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // The tile is repeated over the frame, which may have any size
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<TiledReference> preference, double threshold, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  Result LinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<TiledReference> preference, double threshold, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // Correlates row blocks in a pseudo-random order and stops as soon as the
+  // confidence interval of the correlation lies entirely above threshold, below
+  // -threshold or inside the no watermark band. Otherwise it continues up to the
+  // whole frame. The interval is only tested at 1024 samples and then each time
+  // the sample count doubles, and its quantile is widened by a Bonferroni
+  // correction over these looks. z is the normal quantile for all of them
+  // together (3.29 for 99.9%): the chance that the stopping interval misses the
+  // true correlation is at most that of a single z interval. A frame read to the
+  // end is decided like LinearCorrelation.
+  // The moments of the rows examined are stored in pmoments when given.
+  Result ProgressiveLinearCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, double z = 3.29, Moments* pmoments = nullptr, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // Position of the frame inside the reference: frame pixel (x, y) lines up
+  // with reference pixel (x + dx, y + dy). correlation is the Pearson
+  // correlation of the overlapping area at that offset.
+  struct Peak
+  {
+    int    dx;
+    int    dy;
+    double correlation;
+  };
+
+  // Finds the offset between a shifted or cropped frame and its reference from
+  // the whole cross-correlation surface, computed with one FFT per channel and
+  // side. The frame and the reference may differ in size but not in channels.
+  // The peak is the maximum over all offsets, so the threshold has to be above
+  // the noise level of that maximum for frames without a watermark.
+  Result CrossCorrelation(std::shared_ptr<VideoFrame> pFrame, std::shared_ptr<VideoFrame> pFrameNoise, double threshold, Peak* ppeak = nullptr, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // Correlations of one frame with each of the references in a single pass over
+  // the frame. Empty if the frame or any reference does not match.
+  std::vector<double> LinearCorrelations(std::shared_ptr<VideoFrame> pFrame, const std::vector<std::shared_ptr<VideoFrame>>& references, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  std::vector<double> LinearCorrelations(std::shared_ptr<VideoFrame> pFrame, const std::vector<std::shared_ptr<VideoFrame>>& references, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto);
 };
 
 
-#endif
\ No newline at end of file
+#endif
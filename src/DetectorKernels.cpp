@@ -0,0 +1,615 @@
+#include "DetectorKernels.h"
+
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  using Detector::Moments;
+
+  // f, n, f*f, n*n, f*n
+  const int quantities = 5;
+
+  // Vector kernels keep 32-bit lanes. A lane grows by at most 4 * 255 * 255 per
+  // group (or step of the single channel kernels), so the lanes are flushed to
+  // the 64-bit moments before they overflow.
+  const std::size_t flushGroups = 8192;
+
+  uint64_t* sums(Moments& moments, int quantity)
+  {
+    uint64_t* res[quantities] = { moments.sumF, moments.sumN, moments.sumFF, moments.sumNN, moments.sumFN };
+    return res[quantity];
+  }
+
+  // With Frame false the sums of the frame alone (f and f*f) are skipped, with
+  // Noise false those of the reference alone (n and n*n)
+  template <bool Frame, bool Noise>
+  void accumulateRow_C(const uint8_t* pdata, const uint8_t* pnoise, std::size_t width, Moments& moments)
+  {
+    std::size_t channel = 0;
+    for (std::size_t j = 0; j < width; j++)
+    {
+      uint32_t f = pdata[j];
+      uint32_t n = pnoise[j];
+      if (Frame)
+      {
+        moments.sumF[channel] += f;
+        moments.sumFF[channel] += f * f;
+      }
+      if (Noise)
+      {
+        moments.sumN[channel] += n;
+        moments.sumNN[channel] += n * n;
+      }
+      moments.sumFN[channel] += f * n;
+
+      if (++channel == moments.channels)
+        channel = 0;
+    }
+  }
+
+  template <bool Frame, bool Noise>
+  void accumulate_C(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments)
+  {
+    for (std::size_t i = 0; i < height; i++)
+      accumulateRow_C<Frame, Noise>(pdata + i * stride, pnoise + i * strideNoise, width, moments);
+  }
+
+  uint64_t dot_C(const uint8_t* pa, const uint8_t* pb, std::size_t length)
+  {
+    uint64_t sum = 0;
+    for (std::size_t i = 0; i < length; i++)
+      sum += (uint32_t)pa[i] * pb[i];
+    return sum;
+  }
+
+#ifdef CPU_X86
+  // The vector kernels keep one accumulator per quantity and per phase, the byte
+  // offset of the first lane modulo 3. With interleaved BGR data lane i of an
+  // accumulator then always holds channel (phase + i) % 3, so the channels are
+  // separated only when the lanes are flushed.
+  inline bool frameQuantity(int quantity)
+  {
+    return quantity == 0 || quantity == 2;
+  }
+
+  inline bool noiseQuantity(int quantity)
+  {
+    return quantity == 1 || quantity == 3;
+  }
+
+  template <bool Frame, bool Noise, typename Vector, int Lanes>
+  void flush(Vector (&acc)[quantities][3], Moments& moments)
+  {
+    for (int quantity = 0; quantity < quantities; quantity++)
+    {
+      if ((!Frame && frameQuantity(quantity)) || (!Noise && noiseQuantity(quantity)))
+        continue;
+
+      uint64_t* psums = sums(moments, quantity);
+      for (int phase = 0; phase < 3; phase++)
+      {
+        uint32_t lanes[Lanes];
+        std::memcpy(lanes, &acc[quantity][phase], sizeof(lanes));
+        for (int i = 0; i < Lanes; i++)
+          psums[moments.channels == 1 ? 0 : (phase + i) % 3] += lanes[i];
+        std::memset(&acc[quantity][phase], 0, sizeof(lanes));
+      }
+    }
+  }
+
+  template <bool Frame, bool Noise, int Step>
+  CPU_TARGET("sse4.1")
+  inline void accumulateStep_SSE(const uint8_t* pdata, const uint8_t* pnoise, __m128i (&acc)[quantities][3])
+  {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i f = _mm_loadu_si128((const __m128i*)pdata);
+    __m128i n = _mm_loadu_si128((const __m128i*)pnoise);
+
+    __m128i f16[2] = { _mm_cvtepu8_epi16(f), _mm_unpackhi_epi8(f, zero) };
+    __m128i n16[2] = { _mm_cvtepu8_epi16(n), _mm_unpackhi_epi8(n, zero) };
+
+    for (int half = 0; half < 2; half++)
+    {
+      // 255 * 255 still fits into an unsigned 16-bit lane
+      __m128i values[quantities] = { f16[half], n16[half], _mm_mullo_epi16(f16[half], f16[half]), _mm_mullo_epi16(n16[half], n16[half]), _mm_mullo_epi16(f16[half], n16[half]) };
+
+      // the dwords start at byte offsets 16 * Step + 8 * half and + 4
+      for (int quantity = 0; quantity < quantities; quantity++)
+      {
+        if ((!Frame && frameQuantity(quantity)) || (!Noise && noiseQuantity(quantity)))
+          continue;
+
+        __m128i& lo = acc[quantity][(Step + 2 * half) % 3];
+        __m128i& hi = acc[quantity][(Step + 2 * half + 1) % 3];
+        lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(values[quantity], zero));
+        hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(values[quantity], zero));
+      }
+    }
+  }
+
+  template <bool Frame, bool Noise>
+  CPU_TARGET("sse4.1")
+  void accumulate_SSE(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments)
+  {
+    const std::size_t groupWidth = 48;
+    const std::size_t vectorWidth = width / groupWidth * groupWidth;
+
+    __m128i acc[quantities][3];
+    for (auto& row : acc)
+      for (auto& vector : row)
+        vector = _mm_setzero_si128();
+
+    std::size_t groups = 0;
+    for (std::size_t i = 0; i < height; i++)
+    {
+      const uint8_t* prow = pdata + i * stride;
+      const uint8_t* pnoiseRow = pnoise + i * strideNoise;
+
+      for (std::size_t j = 0; j < vectorWidth; j += groupWidth)
+      {
+        accumulateStep_SSE<Frame, Noise, 0>(prow + j, pnoiseRow + j, acc);
+        accumulateStep_SSE<Frame, Noise, 1>(prow + j + 16, pnoiseRow + j + 16, acc);
+        accumulateStep_SSE<Frame, Noise, 2>(prow + j + 32, pnoiseRow + j + 32, acc);
+
+        if (++groups == flushGroups)
+        {
+          flush<Frame, Noise, __m128i, 4>(acc, moments);
+          groups = 0;
+        }
+      }
+
+      // the group width is a multiple of 3, so the tail starts with channel 0
+      accumulateRow_C<Frame, Noise>(prow + vectorWidth, pnoiseRow + vectorWidth, width - vectorWidth, moments);
+    }
+
+    flush<Frame, Noise, __m128i, 4>(acc, moments);
+  }
+
+  template <bool Frame, bool Noise, int Step>
+  CPU_TARGET("avx2")
+  inline void accumulateStep_AVX(const uint8_t* pdata, const uint8_t* pnoise, __m256i (&acc)[quantities][3])
+  {
+    __m256i f = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)pdata));
+    __m256i n = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)pnoise));
+
+    __m256i values[quantities] = { f, n, _mm256_mullo_epi16(f, f), _mm256_mullo_epi16(n, n), _mm256_mullo_epi16(f, n) };
+
+    // the dwords start at byte offsets 16 * Step and + 8
+    for (int quantity = 0; quantity < quantities; quantity++)
+    {
+      if ((!Frame && frameQuantity(quantity)) || (!Noise && noiseQuantity(quantity)))
+        continue;
+
+      __m256i& lo = acc[quantity][Step % 3];
+      __m256i& hi = acc[quantity][(Step + 2) % 3];
+      lo = _mm256_add_epi32(lo, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(values[quantity])));
+      hi = _mm256_add_epi32(hi, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(values[quantity], 1)));
+    }
+  }
+
+  template <bool Frame, bool Noise>
+  CPU_TARGET("avx2")
+  void accumulate_AVX(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments)
+  {
+    const std::size_t groupWidth = 48;
+    const std::size_t vectorWidth = width / groupWidth * groupWidth;
+
+    __m256i acc[quantities][3];
+    for (auto& row : acc)
+      for (auto& vector : row)
+        vector = _mm256_setzero_si256();
+
+    std::size_t groups = 0;
+    for (std::size_t i = 0; i < height; i++)
+    {
+      const uint8_t* prow = pdata + i * stride;
+      const uint8_t* pnoiseRow = pnoise + i * strideNoise;
+
+      for (std::size_t j = 0; j < vectorWidth; j += groupWidth)
+      {
+        accumulateStep_AVX<Frame, Noise, 0>(prow + j, pnoiseRow + j, acc);
+        accumulateStep_AVX<Frame, Noise, 1>(prow + j + 16, pnoiseRow + j + 16, acc);
+        accumulateStep_AVX<Frame, Noise, 2>(prow + j + 32, pnoiseRow + j + 32, acc);
+
+        if (++groups == flushGroups)
+        {
+          flush<Frame, Noise, __m256i, 8>(acc, moments);
+          groups = 0;
+        }
+      }
+
+      accumulateRow_C<Frame, Noise>(prow + vectorWidth, pnoiseRow + vectorWidth, width - vectorWidth, moments);
+    }
+
+    flush<Frame, Noise, __m256i, 8>(acc, moments);
+  }
+
+  template <bool Frame, bool Noise, int Step>
+  CPU_TARGET("avx512f,avx512bw")
+  inline void accumulateStep_AVX512(const uint8_t* pdata, const uint8_t* pnoise, __mmask64 mask, __m512i (&acc)[quantities][3])
+  {
+    // masked off bytes load as zero and add nothing to any of the sums
+    __m512i f = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(_mm512_maskz_loadu_epi8(mask, pdata)));
+    __m512i n = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(_mm512_maskz_loadu_epi8(mask, pnoise)));
+
+    __m512i values[quantities] = { f, n, _mm512_mullo_epi16(f, f), _mm512_mullo_epi16(n, n), _mm512_mullo_epi16(f, n) };
+
+    // the dwords start at byte offsets 32 * Step and + 16
+    for (int quantity = 0; quantity < quantities; quantity++)
+    {
+      if ((!Frame && frameQuantity(quantity)) || (!Noise && noiseQuantity(quantity)))
+        continue;
+
+      __m512i& lo = acc[quantity][(2 * Step) % 3];
+      __m512i& hi = acc[quantity][(2 * Step + 1) % 3];
+      lo = _mm512_add_epi32(lo, _mm512_cvtepu16_epi32(_mm512_castsi512_si256(values[quantity])));
+      hi = _mm512_add_epi32(hi, _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(values[quantity], 1)));
+    }
+  }
+
+  CPU_TARGET("avx512f,avx512bw")
+  inline __mmask64 tailMask(std::size_t width, std::size_t j)
+  {
+    return j >= width ? 0 : width - j >= 32 ? 0xFFFFFFFFull : (((__mmask64)1 << (width - j)) - 1);
+  }
+
+  template <bool Frame, bool Noise>
+  CPU_TARGET("avx512f,avx512bw")
+  void accumulate_AVX512(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments)
+  {
+    const std::size_t groupWidth = 96;
+
+    __m512i acc[quantities][3];
+    for (auto& row : acc)
+      for (auto& vector : row)
+        vector = _mm512_setzero_si512();
+
+    std::size_t groups = 0;
+    for (std::size_t i = 0; i < height; i++)
+    {
+      const uint8_t* prow = pdata + i * stride;
+      const uint8_t* pnoiseRow = pnoise + i * strideNoise;
+
+      for (std::size_t j = 0; j < width; j += groupWidth)
+      {
+        accumulateStep_AVX512<Frame, Noise, 0>(prow + j, pnoiseRow + j, tailMask(width, j), acc);
+        accumulateStep_AVX512<Frame, Noise, 1>(prow + j + 32, pnoiseRow + j + 32, tailMask(width, j + 32), acc);
+        accumulateStep_AVX512<Frame, Noise, 2>(prow + j + 64, pnoiseRow + j + 64, tailMask(width, j + 64), acc);
+
+        if (++groups == flushGroups)
+        {
+          flush<Frame, Noise, __m512i, 16>(acc, moments);
+          groups = 0;
+        }
+      }
+    }
+
+    flush<Frame, Noise, __m512i, 16>(acc, moments);
+  }
+
+  template <typename Lane, typename Vector>
+  uint64_t horizontalSum(Vector& vector)
+  {
+    Lane lanes[sizeof(Vector) / sizeof(Lane)];
+    std::memcpy(lanes, &vector, sizeof(lanes));
+    std::memset(&vector, 0, sizeof(lanes));
+
+    uint64_t sum = 0;
+    for (Lane lane : lanes)
+      sum += lane;
+    return sum;
+  }
+
+  // sumF and sumN hold 64-bit lanes, the products 32-bit lanes
+  template <bool Frame, bool Noise, typename Vector>
+  void flushGray(Vector& sumF, Vector& sumN, Vector& sumFF, Vector& sumNN, Vector& sumFN, Moments& moments)
+  {
+    if (Frame)
+    {
+      moments.sumF[0] += horizontalSum<uint64_t>(sumF);
+      moments.sumFF[0] += horizontalSum<uint32_t>(sumFF);
+    }
+    if (Noise)
+    {
+      moments.sumN[0] += horizontalSum<uint64_t>(sumN);
+      moments.sumNN[0] += horizontalSum<uint32_t>(sumNN);
+    }
+    moments.sumFN[0] += horizontalSum<uint32_t>(sumFN);
+  }
+
+  // Single channel planes need no phase bookkeeping: sad sums the bytes into
+  // 64-bit lanes and madd adds the products of neighbouring pixels.
+  template <bool Frame, bool Noise>
+  CPU_TARGET("sse4.1")
+  void accumulateGray_SSE(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const std::size_t vectorWidth = width / 16 * 16;
+    __m128i sumF = zero, sumN = zero, sumFF = zero, sumNN = zero, sumFN = zero;
+
+    std::size_t steps = 0;
+    for (std::size_t i = 0; i < height; i++)
+    {
+      const uint8_t* prow = pdata + i * stride;
+      const uint8_t* pnoiseRow = pnoise + i * strideNoise;
+
+      for (std::size_t j = 0; j < vectorWidth; j += 16)
+      {
+        __m128i f = _mm_loadu_si128((const __m128i*)(prow + j));
+        __m128i n = _mm_loadu_si128((const __m128i*)(pnoiseRow + j));
+        __m128i flo = _mm_cvtepu8_epi16(f), fhi = _mm_unpackhi_epi8(f, zero);
+        __m128i nlo = _mm_cvtepu8_epi16(n), nhi = _mm_unpackhi_epi8(n, zero);
+
+        if (Frame)
+        {
+          sumF = _mm_add_epi64(sumF, _mm_sad_epu8(f, zero));
+          sumFF = _mm_add_epi32(sumFF, _mm_add_epi32(_mm_madd_epi16(flo, flo), _mm_madd_epi16(fhi, fhi)));
+        }
+        if (Noise)
+        {
+          sumN = _mm_add_epi64(sumN, _mm_sad_epu8(n, zero));
+          sumNN = _mm_add_epi32(sumNN, _mm_add_epi32(_mm_madd_epi16(nlo, nlo), _mm_madd_epi16(nhi, nhi)));
+        }
+        sumFN = _mm_add_epi32(sumFN, _mm_add_epi32(_mm_madd_epi16(flo, nlo), _mm_madd_epi16(fhi, nhi)));
+
+        if (++steps == flushGroups)
+        {
+          flushGray<Frame, Noise>(sumF, sumN, sumFF, sumNN, sumFN, moments);
+          steps = 0;
+        }
+      }
+
+      accumulateRow_C<Frame, Noise>(prow + vectorWidth, pnoiseRow + vectorWidth, width - vectorWidth, moments);
+    }
+
+    flushGray<Frame, Noise>(sumF, sumN, sumFF, sumNN, sumFN, moments);
+  }
+
+  template <bool Frame, bool Noise>
+  CPU_TARGET("avx2")
+  void accumulateGray_AVX(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const std::size_t vectorWidth = width / 32 * 32;
+    __m256i sumF = zero, sumN = zero, sumFF = zero, sumNN = zero, sumFN = zero;
+
+    std::size_t steps = 0;
+    for (std::size_t i = 0; i < height; i++)
+    {
+      const uint8_t* prow = pdata + i * stride;
+      const uint8_t* pnoiseRow = pnoise + i * strideNoise;
+
+      for (std::size_t j = 0; j < vectorWidth; j += 32)
+      {
+        __m256i f = _mm256_loadu_si256((const __m256i*)(prow + j));
+        __m256i n = _mm256_loadu_si256((const __m256i*)(pnoiseRow + j));
+        __m256i flo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(f)), fhi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(f, 1));
+        __m256i nlo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(n)), nhi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(n, 1));
+
+        if (Frame)
+        {
+          sumF = _mm256_add_epi64(sumF, _mm256_sad_epu8(f, zero));
+          sumFF = _mm256_add_epi32(sumFF, _mm256_add_epi32(_mm256_madd_epi16(flo, flo), _mm256_madd_epi16(fhi, fhi)));
+        }
+        if (Noise)
+        {
+          sumN = _mm256_add_epi64(sumN, _mm256_sad_epu8(n, zero));
+          sumNN = _mm256_add_epi32(sumNN, _mm256_add_epi32(_mm256_madd_epi16(nlo, nlo), _mm256_madd_epi16(nhi, nhi)));
+        }
+        sumFN = _mm256_add_epi32(sumFN, _mm256_add_epi32(_mm256_madd_epi16(flo, nlo), _mm256_madd_epi16(fhi, nhi)));
+
+        if (++steps == flushGroups)
+        {
+          flushGray<Frame, Noise>(sumF, sumN, sumFF, sumNN, sumFN, moments);
+          steps = 0;
+        }
+      }
+
+      accumulateRow_C<Frame, Noise>(prow + vectorWidth, pnoiseRow + vectorWidth, width - vectorWidth, moments);
+    }
+
+    flushGray<Frame, Noise>(sumF, sumN, sumFF, sumNN, sumFN, moments);
+  }
+
+  template <bool Frame, bool Noise>
+  CPU_TARGET("avx512f,avx512bw")
+  void accumulateGray_AVX512(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments)
+  {
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i sumF = zero, sumN = zero, sumFF = zero, sumNN = zero, sumFN = zero;
+
+    std::size_t steps = 0;
+    for (std::size_t i = 0; i < height; i++)
+    {
+      const uint8_t* prow = pdata + i * stride;
+      const uint8_t* pnoiseRow = pnoise + i * strideNoise;
+
+      for (std::size_t j = 0; j < width; j += 64)
+      {
+        __mmask64 mask = width - j >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (width - j)) - 1);
+        __m512i f = _mm512_maskz_loadu_epi8(mask, prow + j);
+        __m512i n = _mm512_maskz_loadu_epi8(mask, pnoiseRow + j);
+        __m512i flo = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(f)), fhi = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(f, 1));
+        __m512i nlo = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(n)), nhi = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(n, 1));
+
+        if (Frame)
+        {
+          sumF = _mm512_add_epi64(sumF, _mm512_sad_epu8(f, zero));
+          sumFF = _mm512_add_epi32(sumFF, _mm512_add_epi32(_mm512_madd_epi16(flo, flo), _mm512_madd_epi16(fhi, fhi)));
+        }
+        if (Noise)
+        {
+          sumN = _mm512_add_epi64(sumN, _mm512_sad_epu8(n, zero));
+          sumNN = _mm512_add_epi32(sumNN, _mm512_add_epi32(_mm512_madd_epi16(nlo, nlo), _mm512_madd_epi16(nhi, nhi)));
+        }
+        sumFN = _mm512_add_epi32(sumFN, _mm512_add_epi32(_mm512_madd_epi16(flo, nlo), _mm512_madd_epi16(fhi, nhi)));
+
+        if (++steps == flushGroups)
+        {
+          flushGray<Frame, Noise>(sumF, sumN, sumFF, sumNN, sumFN, moments);
+          steps = 0;
+        }
+      }
+    }
+
+    flushGray<Frame, Noise>(sumF, sumN, sumFF, sumNN, sumFN, moments);
+  }
+
+  // madd adds two products of at most 255 * 255 per 32-bit lane and step
+  const std::size_t dotFlushSteps = 16384;
+
+  CPU_TARGET("sse4.1")
+  uint64_t dot_SSE(const uint8_t* pa, const uint8_t* pb, std::size_t length)
+  {
+    const std::size_t vectorLength = length / 8 * 8;
+    uint64_t sum = 0;
+    __m128i acc = _mm_setzero_si128();
+    std::size_t steps = 0;
+    for (std::size_t i = 0; i < vectorLength; i += 8)
+    {
+      __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pa + i)));
+      __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pb + i)));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+
+      if (++steps == dotFlushSteps || i + 8 == vectorLength)
+      {
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        acc = _mm_setzero_si128();
+        steps = 0;
+      }
+    }
+
+    return sum + dot_C(pa + vectorLength, pb + vectorLength, length - vectorLength);
+  }
+
+  CPU_TARGET("avx2")
+  uint64_t dot_AVX(const uint8_t* pa, const uint8_t* pb, std::size_t length)
+  {
+    const std::size_t vectorLength = length / 16 * 16;
+    uint64_t sum = 0;
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t steps = 0;
+    for (std::size_t i = 0; i < vectorLength; i += 16)
+    {
+      __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pa + i)));
+      __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pb + i)));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a, b));
+
+      if (++steps == dotFlushSteps || i + 16 == vectorLength)
+      {
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        for (uint32_t lane : lanes)
+          sum += lane;
+        acc = _mm256_setzero_si256();
+        steps = 0;
+      }
+    }
+
+    return sum + dot_C(pa + vectorLength, pb + vectorLength, length - vectorLength);
+  }
+
+  CPU_TARGET("avx512f,avx512bw")
+  uint64_t dot_AVX512(const uint8_t* pa, const uint8_t* pb, std::size_t length)
+  {
+    uint64_t sum = 0;
+    __m512i acc = _mm512_setzero_si512();
+    std::size_t steps = 0;
+    for (std::size_t i = 0; i < length; i += 32)
+    {
+      __mmask64 mask = tailMask(length, i);
+      __m512i a = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(_mm512_maskz_loadu_epi8(mask, pa + i)));
+      __m512i b = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(_mm512_maskz_loadu_epi8(mask, pb + i)));
+      acc = _mm512_add_epi32(acc, _mm512_madd_epi16(a, b));
+
+      if (++steps == dotFlushSteps || i + 32 >= length)
+      {
+        uint32_t lanes[16];
+        _mm512_storeu_si512(lanes, acc);
+        for (uint32_t lane : lanes)
+          sum += lane;
+        acc = _mm512_setzero_si512();
+        steps = 0;
+      }
+    }
+
+    return sum;
+  }
+#endif
+
+  template <bool Frame, bool Noise>
+  void accumulateImpl(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments, VideoFrame::Optimization optimization)
+  {
+    moments.count += width / moments.channels * height;
+
+#ifdef CPU_X86
+    if (moments.channels == 1 && optimization == VideoFrame::AVX512)
+    {
+      accumulateGray_AVX512<Frame, Noise>(pdata, stride, pnoise, strideNoise, width, height, moments);
+      return;
+    }
+    else if (moments.channels == 1 && optimization == VideoFrame::AVX)
+    {
+      accumulateGray_AVX<Frame, Noise>(pdata, stride, pnoise, strideNoise, width, height, moments);
+      return;
+    }
+    else if (moments.channels == 1 && optimization == VideoFrame::SSE && CpuFeatures::SSE41())
+    {
+      accumulateGray_SSE<Frame, Noise>(pdata, stride, pnoise, strideNoise, width, height, moments);
+      return;
+    }
+    else if (optimization == VideoFrame::AVX512)
+    {
+      accumulate_AVX512<Frame, Noise>(pdata, stride, pnoise, strideNoise, width, height, moments);
+      return;
+    }
+    else if (optimization == VideoFrame::AVX)
+    {
+      accumulate_AVX<Frame, Noise>(pdata, stride, pnoise, strideNoise, width, height, moments);
+      return;
+    }
+    else if (optimization == VideoFrame::SSE && CpuFeatures::SSE41())
+    {
+      accumulate_SSE<Frame, Noise>(pdata, stride, pnoise, strideNoise, width, height, moments);
+      return;
+    }
+#endif
+    accumulate_C<Frame, Noise>(pdata, stride, pnoise, strideNoise, width, height, moments);
+  }
+}
+
+void DetectorKernels::accumulate(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments, VideoFrame::Optimization optimization)
+{
+  accumulateImpl<true, true>(pdata, stride, pnoise, strideNoise, width, height, moments, optimization);
+}
+
+void DetectorKernels::accumulateReference(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments, VideoFrame::Optimization optimization)
+{
+  accumulateImpl<false, true>(pdata, stride, pnoise, strideNoise, width, height, moments, optimization);
+}
+
+void DetectorKernels::accumulateFrame(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Moments& moments, VideoFrame::Optimization optimization)
+{
+  accumulateImpl<true, false>(pdata, stride, pnoise, strideNoise, width, height, moments, optimization);
+}
+
+uint64_t DetectorKernels::dot(const uint8_t* pa, const uint8_t* pb, std::size_t length, VideoFrame::Optimization optimization)
+{
+#ifdef CPU_X86
+  if (optimization == VideoFrame::AVX512)
+    return dot_AVX512(pa, pb, length);
+  else if (optimization == VideoFrame::AVX)
+    return dot_AVX(pa, pb, length);
+  else if (optimization == VideoFrame::SSE && CpuFeatures::SSE41())
+    return dot_SSE(pa, pb, length);
+#endif
+  return dot_C(pa, pb, length);
+}
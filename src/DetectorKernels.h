@@ -0,0 +1,25 @@
+#ifndef DETECTOR_KERNELS_H_
+#define DETECTOR_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Detector.h"
+#include "VideoFrame.h"
+
+namespace DetectorKernels
+{
+  // Adds the sums of `width` bytes of each of `height` rows to the moments.
+  // Rows hold interleaved pixels of moments.channels (1 or 3) channels.
+  // The optimization must already be resolved with VideoFrame::resolveOptimization.
+  void accumulate(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Detector::Moments& moments, VideoFrame::Optimization optimization);
+  // Same, but leaves sumF and sumFF alone for callers that already have the frame sums
+  void accumulateReference(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Detector::Moments& moments, VideoFrame::Optimization optimization);
+  // Same, but leaves sumN and sumNN alone for references with precomputed sums
+  void accumulateFrame(const uint8_t* pdata, std::size_t stride, const uint8_t* pnoise, std::size_t strideNoise, std::size_t width, std::size_t height, Detector::Moments& moments, VideoFrame::Optimization optimization);
+
+  // Sum of pa[i] * pb[i] over `length` bytes
+  uint64_t dot(const uint8_t* pa, const uint8_t* pb, std::size_t length, VideoFrame::Optimization optimization);
+};
+
+#endif
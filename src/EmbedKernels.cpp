@@ -0,0 +1,229 @@
+#include "EmbedKernels.h"
+
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+EmbedKernels::Gain EmbedKernels::makeGain(double alpha)
+{
+  // alpha greater than one is applied twice, as the reference implementation always did
+  double gain = alpha > 1.0 ? alpha * alpha : alpha;
+  if (gain < 0.0)
+    gain = 0.0;
+
+  Gain res = { 32767, 8, false };
+  for (int shift = 0; shift <= 8; shift++)
+  {
+    double factor = std::round(gain * (1 << (16 - shift)));
+    if (factor <= 32767.0)
+    {
+      res.factor = (uint16_t)factor;
+      res.shift = shift;
+      break;
+    }
+  }
+
+  return res;
+}
+
+EmbedKernels::Gain EmbedKernels::prescaledGain()
+{
+  Gain res = { 0, 0, true };
+  return res;
+}
+
+uint8_t EmbedKernels::scale(uint8_t reference, Gain gain)
+{
+  if (gain.prescaled)
+    return reference;
+
+  uint32_t wr = ((uint32_t)(reference << gain.shift) * gain.factor) >> 16;
+  return (uint8_t)std::min<uint32_t>(255, wr);
+}
+
+void EmbedKernels::scale(const uint8_t* psrc, std::size_t srcStride, uint8_t* pdst, std::size_t dstStride, std::size_t width, std::size_t height, Gain gain)
+{
+  for (std::size_t i = 0; i < height; i++)
+  {
+    for (std::size_t j = 0; j < width; j++)
+      pdst[i * dstStride + j] = scale(psrc[i * srcStride + j], gain);
+  }
+}
+
+namespace
+{
+  using EmbedKernels::Gain;
+
+  template <bool Scale>
+  inline void applyRow_C(const uint8_t* preference, uint8_t* pdata, std::size_t width, Gain gain, bool key)
+  {
+    for (std::size_t j = 0; j < width; j++)
+    {
+      int val = pdata[j];
+      int wr = Scale ? EmbedKernels::scale(preference[j], gain) : preference[j];
+      if (key)
+        val = std::min(255, val + wr);
+      else
+        val = std::max(0, val - wr);
+      pdata[j] = val;
+    }
+  }
+
+  template <bool Scale>
+  void apply_C(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, Gain gain, bool key)
+  {
+    for (std::size_t i = 0; i < height; i++)
+      applyRow_C<Scale>(preference + i * refStride, pdata + i * stride, width, gain, key);
+  }
+
+#ifdef CPU_X86
+  template <bool Scale>
+  CPU_TARGET("sse2")
+  void apply_SSE(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, Gain gain, bool key)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i factor = _mm_set1_epi16((short)gain.factor);
+    const __m128i shift = _mm_cvtsi32_si128(gain.shift);
+    const std::size_t vectorWidth = width / 16 * 16;
+
+    for (std::size_t i = 0; i < height; i++)
+    {
+      uint8_t* prow = pdata + i * stride;
+      const uint8_t* pwr = preference + i * refStride;
+
+      for (std::size_t j = 0; j < vectorWidth; j += 16)
+      {
+        __m128i val = _mm_loadu_si128((const __m128i*)(prow + j));
+        __m128i wr = _mm_loadu_si128((const __m128i*)(pwr + j));
+
+        if (Scale)
+        {
+          __m128i lo = _mm_mulhi_epu16(_mm_sll_epi16(_mm_unpacklo_epi8(wr, zero), shift), factor);
+          __m128i hi = _mm_mulhi_epu16(_mm_sll_epi16(_mm_unpackhi_epi8(wr, zero), shift), factor);
+          wr = _mm_packus_epi16(lo, hi);
+        }
+
+        if (key)
+          val = _mm_adds_epu8(val, wr);
+        else
+          val = _mm_subs_epu8(val, wr);
+
+        _mm_storeu_si128((__m128i*)(prow + j), val);
+      }
+
+      applyRow_C<Scale>(pwr + vectorWidth, prow + vectorWidth, width - vectorWidth, gain, key);
+    }
+  }
+
+  template <bool Scale>
+  CPU_TARGET("avx2")
+  void apply_AVX(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, Gain gain, bool key)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i factor = _mm256_set1_epi16((short)gain.factor);
+    const __m128i shift = _mm_cvtsi32_si128(gain.shift);
+    const std::size_t vectorWidth = width / 32 * 32;
+
+    for (std::size_t i = 0; i < height; i++)
+    {
+      uint8_t* prow = pdata + i * stride;
+      const uint8_t* pwr = preference + i * refStride;
+
+      for (std::size_t j = 0; j < vectorWidth; j += 32)
+      {
+        __m256i val = _mm256_loadu_si256((const __m256i*)(prow + j));
+        __m256i wr = _mm256_loadu_si256((const __m256i*)(pwr + j));
+
+        if (Scale)
+        {
+          // unpack and pack both work within 128-bit lanes, so the byte order is preserved
+          __m256i lo = _mm256_mulhi_epu16(_mm256_sll_epi16(_mm256_unpacklo_epi8(wr, zero), shift), factor);
+          __m256i hi = _mm256_mulhi_epu16(_mm256_sll_epi16(_mm256_unpackhi_epi8(wr, zero), shift), factor);
+          wr = _mm256_packus_epi16(lo, hi);
+        }
+
+        if (key)
+          val = _mm256_adds_epu8(val, wr);
+        else
+          val = _mm256_subs_epu8(val, wr);
+
+        _mm256_storeu_si256((__m256i*)(prow + j), val);
+      }
+
+      applyRow_C<Scale>(pwr + vectorWidth, prow + vectorWidth, width - vectorWidth, gain, key);
+    }
+  }
+
+  template <bool Scale>
+  CPU_TARGET("avx512f,avx512bw")
+  void apply_AVX512(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, Gain gain, bool key)
+  {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i factor = _mm512_set1_epi16((short)gain.factor);
+    const __m128i shift = _mm_cvtsi32_si128(gain.shift);
+
+    for (std::size_t i = 0; i < height; i++)
+    {
+      uint8_t* prow = pdata + i * stride;
+      const uint8_t* pwr = preference + i * refStride;
+
+      for (std::size_t j = 0; j < width; j += 64)
+      {
+        __mmask64 mask = width - j >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << (width - j)) - 1);
+
+        __m512i val = _mm512_maskz_loadu_epi8(mask, prow + j);
+        __m512i wr = _mm512_maskz_loadu_epi8(mask, pwr + j);
+
+        if (Scale)
+        {
+          __m512i lo = _mm512_mulhi_epu16(_mm512_sll_epi16(_mm512_unpacklo_epi8(wr, zero), shift), factor);
+          __m512i hi = _mm512_mulhi_epu16(_mm512_sll_epi16(_mm512_unpackhi_epi8(wr, zero), shift), factor);
+          wr = _mm512_packus_epi16(lo, hi);
+        }
+
+        if (key)
+          val = _mm512_adds_epu8(val, wr);
+        else
+          val = _mm512_subs_epu8(val, wr);
+
+        _mm512_mask_storeu_epi8(prow + j, mask, val);
+      }
+    }
+  }
+#endif
+
+  template <bool Scale>
+  void applyImpl(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, Gain gain, bool key, VideoFrame::Optimization optimization)
+  {
+#ifdef CPU_X86
+    if (optimization == VideoFrame::AVX512)
+    {
+      apply_AVX512<Scale>(preference, refStride, pdata, stride, width, height, gain, key);
+      return;
+    }
+    else if (optimization == VideoFrame::AVX)
+    {
+      apply_AVX<Scale>(preference, refStride, pdata, stride, width, height, gain, key);
+      return;
+    }
+    else if (optimization == VideoFrame::SSE)
+    {
+      apply_SSE<Scale>(preference, refStride, pdata, stride, width, height, gain, key);
+      return;
+    }
+#endif
+    apply_C<Scale>(preference, refStride, pdata, stride, width, height, gain, key);
+  }
+}
+
+void EmbedKernels::apply(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, Gain gain, bool key, VideoFrame::Optimization optimization)
+{
+  if (gain.prescaled)
+    applyImpl<false>(preference, refStride, pdata, stride, width, height, gain, key, optimization);
+  else
+    applyImpl<true>(preference, refStride, pdata, stride, width, height, gain, key, optimization);
+}
@@ -0,0 +1,32 @@
+#ifndef EMBED_KERNELS_H_
+#define EMBED_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "VideoFrame.h"
+
+namespace EmbedKernels
+{
+  // Fixed point representation of the embedding strength:
+  // wr = ((reference << shift) * factor) >> 16, computed in 16-bit lanes.
+  // A prescaled gain means the reference already holds the final values.
+  struct Gain
+  {
+    uint16_t factor;
+    int      shift;
+    bool     prescaled;
+  };
+
+  Gain makeGain(double alpha);
+  Gain prescaledGain();
+
+  uint8_t scale(uint8_t reference, Gain gain);
+  void scale(const uint8_t* psrc, std::size_t srcStride, uint8_t* pdst, std::size_t dstStride, std::size_t width, std::size_t height, Gain gain);
+
+  // Adds (key) or subtracts the scaled reference from `width` bytes of each of `height` rows with saturation.
+  // The optimization must already be resolved with VideoFrame::resolveOptimization.
+  void apply(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, Gain gain, bool key, VideoFrame::Optimization optimization);
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "FramePool.h"
+
+FramePool::FramePool(std::size_t maxFreeBuffers):
+  m_maxFreeBuffers(maxFreeBuffers),
+  m_allocations(0)
+{
+}
+
+AlignedBuffer FramePool::acquire(std::size_t width, std::size_t height, int format, int plane, std::size_t size)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_free.find(Key(width, height, format, plane));
+    if (it != m_free.end() && !it->second.empty())
+    {
+      AlignedBuffer buffer = std::move(it->second.back());
+      it->second.pop_back();
+      if (buffer.size() == size)
+        return buffer;
+    }
+    m_allocations++;
+  }
+
+  // contents are left uninitialized, the frame is expected to be overwritten
+  AlignedBuffer buffer;
+  buffer.resize(size);
+  return buffer;
+}
+
+void FramePool::release(std::size_t width, std::size_t height, int format, int plane, AlignedBuffer&& buffer)
+{
+  if (buffer.empty())
+    return;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  std::vector<AlignedBuffer>& buffers = m_free[Key(width, height, format, plane)];
+  if (buffers.size() < m_maxFreeBuffers)
+    buffers.push_back(std::move(buffer));
+}
+
+std::size_t FramePool::allocations() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_allocations;
+}
+
+std::size_t FramePool::freeBuffers() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  std::size_t res = 0;
+  for (auto& item : m_free)
+    res += item.second.size();
+  return res;
+}
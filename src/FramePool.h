@@ -0,0 +1,37 @@
+#ifndef FRAME_POOL_H_
+#define FRAME_POOL_H_
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "AlignedAllocator.h"
+
+// Recycles plane buffers of frames with the same geometry. Frames created with
+// a pool borrow their planes from it and return them on destruction, so a
+// steady stream of equally sized frames does not allocate.
+class FramePool
+{
+public:
+  // maxFreeBuffers limits how many idle buffers are kept per plane geometry
+  FramePool(std::size_t maxFreeBuffers = 64);
+
+  AlignedBuffer acquire(std::size_t width, std::size_t height, int format, int plane, std::size_t size);
+  void release(std::size_t width, std::size_t height, int format, int plane, AlignedBuffer&& buffer);
+
+  // number of buffers allocated by the pool since construction
+  std::size_t allocations() const;
+  std::size_t freeBuffers() const;
+
+private:
+  typedef std::tuple<std::size_t, std::size_t, int, int> Key;
+
+  std::size_t                               m_maxFreeBuffers;
+  std::size_t                               m_allocations;
+  std::map<Key, std::vector<AlignedBuffer>> m_free;
+  mutable std::mutex                        m_mutex;
+};
+
+#endif
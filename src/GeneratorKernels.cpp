@@ -0,0 +1,306 @@
+#include "GeneratorKernels.h"
+
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  const uint32_t multiplier0 = 0xD2511F53;
+  const uint32_t multiplier1 = 0xCD9E8D57;
+  const uint32_t weyl0 = 0x9E3779B9;
+  const uint32_t weyl1 = 0xBB67AE85;
+  const int rounds = 10;
+
+  // 16 Philox blocks of 16 bytes make up a group
+  const std::size_t groupBlocks = 16;
+  const std::size_t groupBytes = groupBlocks * 16;
+
+  inline uint8_t scale(uint32_t value, uint8_t threshold)
+  {
+    return (uint8_t)((value * threshold) >> 8);
+  }
+
+  void generate_C(uint8_t* pdst, uint64_t key, uint32_t row, std::size_t group, std::size_t groups, uint8_t threshold)
+  {
+    for (std::size_t g = 0; g < groups; g++, pdst += groupBytes)
+    {
+      for (std::size_t block = 0; block < groupBlocks; block++)
+      {
+        uint32_t counter[4] = { (uint32_t)((group + g) * groupBlocks + block), row, 0, 0 };
+        uint32_t words[4];
+        GeneratorKernels::philox(counter, key, words);
+
+        for (int word = 0; word < 4; word++)
+        {
+          for (int byte = 0; byte < 4; byte++)
+            pdst[word * 64 + block * 4 + byte] = scale((words[word] >> (8 * byte)) & 0xFF, threshold);
+        }
+      }
+    }
+  }
+
+#ifdef CPU_X86
+  // The vector kernels run one Philox block per 32-bit lane, so a register of
+  // each of the four counter words is exactly one word row of a group.
+
+  CPU_TARGET("sse2")
+  inline void mulhilo_SSE(__m128i a, __m128i multiplier, __m128i& hi, __m128i& lo)
+  {
+    __m128i even = _mm_mul_epu32(a, multiplier);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), multiplier);
+    __m128i first = _mm_unpacklo_epi32(even, odd);
+    __m128i second = _mm_unpackhi_epi32(even, odd);
+    lo = _mm_unpacklo_epi64(first, second);
+    hi = _mm_unpackhi_epi64(first, second);
+  }
+
+  CPU_TARGET("sse2")
+  inline __m128i scale_SSE(__m128i bytes, __m128i threshold)
+  {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(bytes, zero), threshold), 8);
+    __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(bytes, zero), threshold), 8);
+    return _mm_packus_epi16(lo, hi);
+  }
+
+  CPU_TARGET("sse2")
+  void generate_SSE(uint8_t* pdst, uint64_t key, uint32_t row, std::size_t group, std::size_t groups, uint8_t threshold)
+  {
+    const std::size_t lanes = 4;
+    const __m128i scaleThreshold = _mm_set1_epi16(threshold);
+    const __m128i m0 = _mm_set1_epi32((int)multiplier0);
+    const __m128i m1 = _mm_set1_epi32((int)multiplier1);
+    const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+
+    for (std::size_t g = 0; g < groups; g++, pdst += groupBytes)
+    {
+      for (std::size_t part = 0; part < groupBlocks / lanes; part++)
+      {
+        __m128i c0 = _mm_add_epi32(_mm_set1_epi32((int)((group + g) * groupBlocks + part * lanes)), laneIndex);
+        __m128i c1 = _mm_set1_epi32((int)row);
+        __m128i c2 = _mm_setzero_si128();
+        __m128i c3 = _mm_setzero_si128();
+
+        uint32_t k0 = (uint32_t)key;
+        uint32_t k1 = (uint32_t)(key >> 32);
+        for (int round = 0; round < rounds; round++, k0 += weyl0, k1 += weyl1)
+        {
+          __m128i hi0, lo0, hi1, lo1;
+          mulhilo_SSE(c0, m0, hi0, lo0);
+          mulhilo_SSE(c2, m1, hi1, lo1);
+          c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+          c1 = lo1;
+          c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+          c3 = lo0;
+        }
+
+        _mm_storeu_si128((__m128i*)(pdst + 0 * 64 + part * lanes * 4), scale_SSE(c0, scaleThreshold));
+        _mm_storeu_si128((__m128i*)(pdst + 1 * 64 + part * lanes * 4), scale_SSE(c1, scaleThreshold));
+        _mm_storeu_si128((__m128i*)(pdst + 2 * 64 + part * lanes * 4), scale_SSE(c2, scaleThreshold));
+        _mm_storeu_si128((__m128i*)(pdst + 3 * 64 + part * lanes * 4), scale_SSE(c3, scaleThreshold));
+      }
+    }
+  }
+
+  // The unpacks work within 128-bit lanes, which keeps the lane order of the
+  // wider registers intact.
+  CPU_TARGET("avx2")
+  inline void mulhilo_AVX(__m256i a, __m256i multiplier, __m256i& hi, __m256i& lo)
+  {
+    __m256i even = _mm256_mul_epu32(a, multiplier);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), multiplier);
+    __m256i first = _mm256_unpacklo_epi32(even, odd);
+    __m256i second = _mm256_unpackhi_epi32(even, odd);
+    lo = _mm256_unpacklo_epi64(first, second);
+    hi = _mm256_unpackhi_epi64(first, second);
+  }
+
+  CPU_TARGET("avx2")
+  inline __m256i scale_AVX(__m256i bytes, __m256i threshold)
+  {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(bytes, zero), threshold), 8);
+    __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(bytes, zero), threshold), 8);
+    return _mm256_packus_epi16(lo, hi);
+  }
+
+  CPU_TARGET("avx2")
+  void generate_AVX(uint8_t* pdst, uint64_t key, uint32_t row, std::size_t group, std::size_t groups, uint8_t threshold)
+  {
+    const std::size_t lanes = 8;
+    const __m256i scaleThreshold = _mm256_set1_epi16(threshold);
+    const __m256i m0 = _mm256_set1_epi32((int)multiplier0);
+    const __m256i m1 = _mm256_set1_epi32((int)multiplier1);
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (std::size_t g = 0; g < groups; g++, pdst += groupBytes)
+    {
+      for (std::size_t part = 0; part < groupBlocks / lanes; part++)
+      {
+        __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)((group + g) * groupBlocks + part * lanes)), laneIndex);
+        __m256i c1 = _mm256_set1_epi32((int)row);
+        __m256i c2 = _mm256_setzero_si256();
+        __m256i c3 = _mm256_setzero_si256();
+
+        uint32_t k0 = (uint32_t)key;
+        uint32_t k1 = (uint32_t)(key >> 32);
+        for (int round = 0; round < rounds; round++, k0 += weyl0, k1 += weyl1)
+        {
+          __m256i hi0, lo0, hi1, lo1;
+          mulhilo_AVX(c0, m0, hi0, lo0);
+          mulhilo_AVX(c2, m1, hi1, lo1);
+          c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+          c1 = lo1;
+          c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+          c3 = lo0;
+        }
+
+        _mm256_storeu_si256((__m256i*)(pdst + 0 * 64 + part * lanes * 4), scale_AVX(c0, scaleThreshold));
+        _mm256_storeu_si256((__m256i*)(pdst + 1 * 64 + part * lanes * 4), scale_AVX(c1, scaleThreshold));
+        _mm256_storeu_si256((__m256i*)(pdst + 2 * 64 + part * lanes * 4), scale_AVX(c2, scaleThreshold));
+        _mm256_storeu_si256((__m256i*)(pdst + 3 * 64 + part * lanes * 4), scale_AVX(c3, scaleThreshold));
+      }
+    }
+  }
+
+  CPU_TARGET("avx512f,avx512bw")
+  inline void mulhilo_AVX512(__m512i a, __m512i multiplier, __m512i& hi, __m512i& lo)
+  {
+    __m512i even = _mm512_mul_epu32(a, multiplier);
+    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), multiplier);
+    __m512i first = _mm512_unpacklo_epi32(even, odd);
+    __m512i second = _mm512_unpackhi_epi32(even, odd);
+    lo = _mm512_unpacklo_epi64(first, second);
+    hi = _mm512_unpackhi_epi64(first, second);
+  }
+
+  CPU_TARGET("avx512f,avx512bw")
+  inline __m512i scale_AVX512(__m512i bytes, __m512i threshold)
+  {
+    __m512i zero = _mm512_setzero_si512();
+    __m512i lo = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpacklo_epi8(bytes, zero), threshold), 8);
+    __m512i hi = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_unpackhi_epi8(bytes, zero), threshold), 8);
+    return _mm512_packus_epi16(lo, hi);
+  }
+
+  // one register holds all 16 blocks of a group
+  CPU_TARGET("avx512f,avx512bw")
+  void generate_AVX512(uint8_t* pdst, uint64_t key, uint32_t row, std::size_t group, std::size_t groups, uint8_t threshold)
+  {
+    const __m512i scaleThreshold = _mm512_set1_epi16(threshold);
+    const __m512i m0 = _mm512_set1_epi32((int)multiplier0);
+    const __m512i m1 = _mm512_set1_epi32((int)multiplier1);
+    const __m512i laneIndex = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    for (std::size_t g = 0; g < groups; g++, pdst += groupBytes)
+    {
+      __m512i c0 = _mm512_add_epi32(_mm512_set1_epi32((int)((group + g) * groupBlocks)), laneIndex);
+      __m512i c1 = _mm512_set1_epi32((int)row);
+      __m512i c2 = _mm512_setzero_si512();
+      __m512i c3 = _mm512_setzero_si512();
+
+      uint32_t k0 = (uint32_t)key;
+      uint32_t k1 = (uint32_t)(key >> 32);
+      for (int round = 0; round < rounds; round++, k0 += weyl0, k1 += weyl1)
+      {
+        __m512i hi0, lo0, hi1, lo1;
+        mulhilo_AVX512(c0, m0, hi0, lo0);
+        mulhilo_AVX512(c2, m1, hi1, lo1);
+        c0 = _mm512_xor_si512(_mm512_xor_si512(hi1, c1), _mm512_set1_epi32((int)k0));
+        c1 = lo1;
+        c2 = _mm512_xor_si512(_mm512_xor_si512(hi0, c3), _mm512_set1_epi32((int)k1));
+        c3 = lo0;
+      }
+
+      _mm512_storeu_si512((void*)(pdst + 0 * 64), scale_AVX512(c0, scaleThreshold));
+      _mm512_storeu_si512((void*)(pdst + 1 * 64), scale_AVX512(c1, scaleThreshold));
+      _mm512_storeu_si512((void*)(pdst + 2 * 64), scale_AVX512(c2, scaleThreshold));
+      _mm512_storeu_si512((void*)(pdst + 3 * 64), scale_AVX512(c3, scaleThreshold));
+    }
+  }
+#endif
+
+  void generateGroups(uint8_t* pdst, uint64_t key, uint32_t row, std::size_t group, std::size_t groups, uint8_t threshold, VideoFrame::Optimization optimization)
+  {
+#ifdef CPU_X86
+    if (optimization == VideoFrame::AVX512)
+    {
+      generate_AVX512(pdst, key, row, group, groups, threshold);
+      return;
+    }
+    else if (optimization == VideoFrame::AVX)
+    {
+      generate_AVX(pdst, key, row, group, groups, threshold);
+      return;
+    }
+    else if (optimization == VideoFrame::SSE)
+    {
+      generate_SSE(pdst, key, row, group, groups, threshold);
+      return;
+    }
+#endif
+    generate_C(pdst, key, row, group, groups, threshold);
+  }
+}
+
+void GeneratorKernels::philox(const uint32_t (&counter)[4], uint64_t key, uint32_t (&result)[4])
+{
+  uint32_t c0 = counter[0];
+  uint32_t c1 = counter[1];
+  uint32_t c2 = counter[2];
+  uint32_t c3 = counter[3];
+  uint32_t k0 = (uint32_t)key;
+  uint32_t k1 = (uint32_t)(key >> 32);
+
+  for (int round = 0; round < rounds; round++, k0 += weyl0, k1 += weyl1)
+  {
+    uint64_t product0 = (uint64_t)multiplier0 * c0;
+    uint64_t product1 = (uint64_t)multiplier1 * c2;
+    c0 = (uint32_t)(product1 >> 32) ^ c1 ^ k0;
+    c1 = (uint32_t)product1;
+    c2 = (uint32_t)(product0 >> 32) ^ c3 ^ k1;
+    c3 = (uint32_t)product0;
+  }
+
+  result[0] = c0;
+  result[1] = c1;
+  result[2] = c2;
+  result[3] = c3;
+}
+
+void GeneratorKernels::generate(uint8_t* pdst, uint64_t key, uint32_t row, std::size_t first, std::size_t count, uint8_t threshold, VideoFrame::Optimization optimization)
+{
+  std::size_t group = first / groupBytes;
+  std::size_t offset = first % groupBytes;
+
+  while (count > 0)
+  {
+    if (offset == 0 && count >= groupBytes)
+    {
+      std::size_t groups = count / groupBytes;
+      generateGroups(pdst, key, row, group, groups, threshold, optimization);
+      pdst += groups * groupBytes;
+      count -= groups * groupBytes;
+      group += groups;
+    }
+    else
+    {
+      // partial groups at the ends of the range go through a buffer
+      uint8_t buffer[groupBytes];
+      generateGroups(buffer, key, row, group, 1, threshold, optimization);
+
+      std::size_t bytes = std::min(count, groupBytes - offset);
+      std::memcpy(pdst, buffer + offset, bytes);
+      pdst += bytes;
+      count -= bytes;
+      group++;
+      offset = 0;
+    }
+  }
+}
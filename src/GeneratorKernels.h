@@ -0,0 +1,25 @@
+#ifndef GENERATOR_KERNELS_H_
+#define GENERATOR_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "VideoFrame.h"
+
+namespace GeneratorKernels
+{
+  // Philox4x32-10 counter based generator: four 32-bit words from a counter and
+  // a 64-bit key (low word first), with no state carried between calls.
+  void philox(const uint32_t (&counter)[4], uint64_t key, uint32_t (&result)[4]);
+
+  // Writes bytes [first, first + count) of row `row` of the keyed stream,
+  // scaled to [0, threshold) as (byte * threshold) >> 8. Each 256 byte group of
+  // a row holds 16 Philox blocks word by word: word w of block j is stored at
+  // (j / 16) * 256 + w * 64 + (j % 16) * 4 and block j uses the counter
+  // (j, row, 0, 0). Every byte depends only on key, row and its position, so
+  // any part of the stream can be generated on its own.
+  // The optimization must already be resolved with VideoFrame::resolveOptimization.
+  void generate(uint8_t* pdst, uint64_t key, uint32_t row, std::size_t first, std::size_t count, uint8_t threshold, VideoFrame::Optimization optimization);
+};
+
+#endif
@@ -0,0 +1,267 @@
+#include "KeySearch.h"
+
+#include "Detector.h"
+#include "DetectorKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  // Writes the channels of plane 0 as separate rows, box filtered by `downsample`
+  void planarize(const VideoFrame& frame, std::size_t downsample, uint8_t* pdst, std::size_t dstStride)
+  {
+    std::size_t channels = frame.channels();
+    std::size_t width = frame.width() / downsample;
+    std::size_t height = frame.height() / downsample;
+    std::size_t area = downsample * downsample;
+    const uint8_t* psrc = frame.data(0);
+
+    for (std::size_t channel = 0; channel < channels; channel++)
+    {
+      uint8_t* prow = pdst + channel * dstStride;
+      for (std::size_t i = 0; i < height; i++)
+      {
+        for (std::size_t j = 0; j < width; j++)
+        {
+          std::size_t sum = 0;
+          for (std::size_t y = 0; y < downsample; y++)
+          {
+            const uint8_t* pblock = psrc + (i * downsample + y) * frame.stride(0) + j * downsample * channels + channel;
+            for (std::size_t x = 0; x < downsample; x++)
+              sum += pblock[x * channels];
+          }
+          prow[i * width + j] = (uint8_t)((sum + area / 2) / area);
+        }
+      }
+    }
+  }
+
+  uint64_t sum(const uint8_t* pdata, std::size_t length)
+  {
+    uint64_t res = 0;
+    for (std::size_t i = 0; i < length; i++)
+      res += pdata[i];
+    return res;
+  }
+}
+
+KeySearch::KeySearch(const std::vector<std::shared_ptr<VideoFrame>>& references, std::size_t downsample):
+  m_size(0),
+  m_width(0),
+  m_height(0),
+  m_channels(1)
+{
+  if (references.empty() || !references[0])
+    return;
+
+  for (auto& preference : references)
+  {
+    if (!preference || preference->width() != references[0]->width() || preference->height() != references[0]->height() || preference->channels() != references[0]->channels())
+      return;
+  }
+
+  m_size = references.size();
+  m_width = references[0]->width();
+  m_height = references[0]->height();
+  m_channels = references[0]->channels();
+
+  buildLevel(m_full, references, 1);
+  if (downsample > 1 && m_width >= downsample && m_height >= downsample)
+    buildLevel(m_coarse, references, downsample);
+}
+
+void KeySearch::buildLevel(Level& level, const std::vector<std::shared_ptr<VideoFrame>>& references, std::size_t downsample)
+{
+  level.downsample = downsample;
+  level.length = (m_width / downsample) * (m_height / downsample);
+  level.stride = alignedStride(level.length);
+
+  std::size_t rows = references.size() * m_channels;
+  level.matrix.assign(rows * level.stride, 0);
+  level.sums.resize(rows);
+  level.sumsOfSquares.resize(rows);
+
+  for (std::size_t reference = 0; reference < references.size(); reference++)
+    planarize(*references[reference], downsample, level.matrix.data() + reference * m_channels * level.stride, level.stride);
+
+  VideoFrame::Optimization optimization = VideoFrame::resolveOptimization(VideoFrame::Auto);
+  for (std::size_t row = 0; row < rows; row++)
+  {
+    const uint8_t* prow = level.matrix.data() + row * level.stride;
+    level.sums[row] = sum(prow, level.length);
+    level.sumsOfSquares[row] = DetectorKernels::dot(prow, prow, level.length, optimization);
+  }
+}
+
+std::size_t KeySearch::size() const
+{
+  return m_size;
+}
+
+std::size_t KeySearch::width() const
+{
+  return m_width;
+}
+
+std::size_t KeySearch::height() const
+{
+  return m_height;
+}
+
+std::size_t KeySearch::channels() const
+{
+  return m_channels;
+}
+
+bool KeySearch::matches(const VideoFrame& frame) const
+{
+  return m_size > 0 && frame.width() == m_width && frame.height() == m_height && frame.channels() == m_channels;
+}
+
+std::vector<std::vector<double>> KeySearch::correlate(const Level& level, const std::vector<std::shared_ptr<VideoFrame>>& frames, const std::vector<std::size_t>& references, ThreadPool& threadPool, VideoFrame::Optimization optimization) const
+{
+  optimization = VideoFrame::resolveOptimization(optimization);
+
+  // the frames in the same layout as the reference matrix
+  std::size_t frameRows = frames.size() * m_channels;
+  AlignedBuffer vectors;
+  vectors.assign(frameRows * level.stride, 0);
+  std::vector<uint64_t> sums(frameRows), sumsOfSquares(frameRows);
+  for (std::size_t frame = 0; frame < frames.size(); frame++)
+    planarize(*frames[frame], level.downsample, vectors.data() + frame * m_channels * level.stride, level.stride);
+  for (std::size_t row = 0; row < frameRows; row++)
+  {
+    const uint8_t* prow = vectors.data() + row * level.stride;
+    sums[row] = sum(prow, level.length);
+    sumsOfSquares[row] = DetectorKernels::dot(prow, prow, level.length, optimization);
+  }
+
+  // Columns are processed in blocks small enough that the block of every frame
+  // stays in L2 while the reference rows stream past, so the matrix is read
+  // once per batch instead of once per frame.
+  const std::size_t cacheBytes = 256 * 1024;
+  std::size_t blockLength = std::max<std::size_t>(4096, cacheBytes / std::max<std::size_t>(1, frames.size()));
+  blockLength = std::min(alignedStride(blockLength), level.stride);
+
+  std::vector<uint64_t> products(references.size() * m_channels * frames.size(), 0);
+  threadPool.parallel_for(0, references.size(), 1, [&](std::size_t first, std::size_t last)
+  {
+    for (std::size_t column = 0; column < level.length; column += blockLength)
+    {
+      std::size_t length = std::min(blockLength, level.length - column);
+      for (std::size_t index = first; index < last; index++)
+      {
+        for (std::size_t channel = 0; channel < m_channels; channel++)
+        {
+          const uint8_t* preference = level.matrix.data() + (references[index] * m_channels + channel) * level.stride + column;
+          for (std::size_t frame = 0; frame < frames.size(); frame++)
+          {
+            const uint8_t* pvector = vectors.data() + (frame * m_channels + channel) * level.stride + column;
+            products[(index * m_channels + channel) * frames.size() + frame] += DetectorKernels::dot(preference, pvector, length, optimization);
+          }
+        }
+      }
+    }
+  });
+
+  std::vector<std::vector<double>> res(frames.size(), std::vector<double>(references.size()));
+  for (std::size_t frame = 0; frame < frames.size(); frame++)
+  {
+    for (std::size_t index = 0; index < references.size(); index++)
+    {
+      Detector::Moments moments(m_channels);
+      moments.count = level.length;
+      for (std::size_t channel = 0; channel < m_channels; channel++)
+      {
+        std::size_t row = references[index] * m_channels + channel;
+        moments.sumF[channel] = sums[frame * m_channels + channel];
+        moments.sumFF[channel] = sumsOfSquares[frame * m_channels + channel];
+        moments.sumN[channel] = level.sums[row];
+        moments.sumNN[channel] = level.sumsOfSquares[row];
+        moments.sumFN[channel] = products[(index * m_channels + channel) * frames.size() + frame];
+      }
+      res[frame][index] = Detector::correlation(moments);
+    }
+  }
+
+  return res;
+}
+
+std::vector<double> KeySearch::correlations(std::shared_ptr<VideoFrame> pFrame, VideoFrame::Optimization optimization) const
+{
+  ThreadPool threadPool(0);
+  return correlations(pFrame, threadPool, optimization);
+}
+
+std::vector<double> KeySearch::correlations(std::shared_ptr<VideoFrame> pFrame, ThreadPool& threadPool, VideoFrame::Optimization optimization) const
+{
+  std::vector<std::vector<double>> res = correlations(std::vector<std::shared_ptr<VideoFrame>>{ pFrame }, threadPool, optimization);
+  if (res.empty())
+    return std::vector<double>();
+
+  return res[0];
+}
+
+std::vector<std::vector<double>> KeySearch::correlations(const std::vector<std::shared_ptr<VideoFrame>>& frames, ThreadPool& threadPool, VideoFrame::Optimization optimization) const
+{
+  for (auto& pframe : frames)
+  {
+    if (!pframe || !matches(*pframe))
+      return std::vector<std::vector<double>>();
+  }
+
+  std::vector<std::size_t> references(m_size);
+  for (std::size_t index = 0; index < m_size; index++)
+    references[index] = index;
+
+  return correlate(m_full, frames, references, threadPool, optimization);
+}
+
+std::vector<KeySearch::Match> KeySearch::search(std::shared_ptr<VideoFrame> pFrame, std::size_t count, VideoFrame::Optimization optimization) const
+{
+  ThreadPool threadPool(0);
+  return search(pFrame, count, threadPool, optimization);
+}
+
+std::vector<KeySearch::Match> KeySearch::search(std::shared_ptr<VideoFrame> pFrame, std::size_t count, ThreadPool& threadPool, VideoFrame::Optimization optimization) const
+{
+  std::vector<Match> matches;
+  if (!pFrame || !this->matches(*pFrame))
+    return matches;
+
+  std::vector<std::shared_ptr<VideoFrame>> frames = { pFrame };
+  std::vector<std::size_t> candidates(m_size);
+  for (std::size_t index = 0; index < m_size; index++)
+    candidates[index] = index;
+
+  auto byMagnitude = [](const Match& a, const Match& b)
+  {
+    return std::fabs(a.correlation) > std::fabs(b.correlation) || (std::fabs(a.correlation) == std::fabs(b.correlation) && a.index < b.index);
+  };
+
+  // the coarse level only preselects, a margin of candidates absorbs its noise
+  if (!m_coarse.matrix.empty())
+  {
+    std::vector<double> coarse = correlate(m_coarse, frames, candidates, threadPool, optimization)[0];
+    std::vector<Match> ranked(m_size);
+    for (std::size_t index = 0; index < m_size; index++)
+      ranked[index] = Match{ index, coarse[index] };
+
+    std::size_t refine = std::min(m_size, std::max<std::size_t>(count * 4, 16));
+    std::partial_sort(ranked.begin(), ranked.begin() + refine, ranked.end(), byMagnitude);
+
+    candidates.resize(refine);
+    for (std::size_t index = 0; index < refine; index++)
+      candidates[index] = ranked[index].index;
+  }
+
+  std::vector<double> full = correlate(m_full, frames, candidates, threadPool, optimization)[0];
+  for (std::size_t index = 0; index < candidates.size(); index++)
+    matches.push_back(Match{ candidates[index], full[index] });
+
+  count = std::min(count, matches.size());
+  std::partial_sort(matches.begin(), matches.begin() + count, matches.end(), byMagnitude);
+  matches.resize(count);
+  return matches;
+}
@@ -0,0 +1,71 @@
+#ifndef KEY_SEARCH_H_
+#define KEY_SEARCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "VideoFrame.h"
+#include "AlignedAllocator.h"
+
+// Correlates frames against a large library of references. The references are
+// kept as a matrix with one row per reference channel, so searching a frame is
+// a matrix-vector product and a batch of frames a matrix-matrix product, both
+// computed blockwise in exact integers. Centering needs no extra pass since
+// sum((f - mean f) * (n - mean n)) = sum(f * n) - sum(f) * sum(n) / count.
+class KeySearch
+{
+public:
+  struct Match
+  {
+    std::size_t index;
+    double      correlation;
+  };
+
+  // All references must share one geometry, otherwise the search is empty.
+  // A downsample factor above 1 also keeps box filtered references for search.
+  KeySearch(const std::vector<std::shared_ptr<VideoFrame>>& references, std::size_t downsample = 0);
+
+  std::size_t size() const;
+  std::size_t width() const;
+  std::size_t height() const;
+  std::size_t channels() const;
+
+  // correlation with every reference, empty if the frame does not match
+  std::vector<double> correlations(std::shared_ptr<VideoFrame> pFrame, VideoFrame::Optimization optimization = VideoFrame::Auto) const;
+  std::vector<double> correlations(std::shared_ptr<VideoFrame> pFrame, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto) const;
+  // one correlation vector per frame, the references are read once for the whole batch
+  std::vector<std::vector<double>> correlations(const std::vector<std::shared_ptr<VideoFrame>>& frames, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto) const;
+
+  // The `count` references with the largest absolute correlation, best first.
+  // With downsampled references they are preselected on the coarse level and
+  // only the best candidates are correlated at full resolution.
+  std::vector<Match> search(std::shared_ptr<VideoFrame> pFrame, std::size_t count, VideoFrame::Optimization optimization = VideoFrame::Auto) const;
+  std::vector<Match> search(std::shared_ptr<VideoFrame> pFrame, std::size_t count, ThreadPool& threadPool, VideoFrame::Optimization optimization = VideoFrame::Auto) const;
+
+private:
+  // references at one resolution, channel planes of all references as rows
+  struct Level
+  {
+    std::size_t           downsample;
+    std::size_t           length;      //pixels of one row
+    std::size_t           stride;
+    AlignedBuffer         matrix;
+    std::vector<uint64_t> sums;
+    std::vector<uint64_t> sumsOfSquares;
+  };
+
+  void buildLevel(Level& level, const std::vector<std::shared_ptr<VideoFrame>>& references, std::size_t downsample);
+  bool matches(const VideoFrame& frame) const;
+  std::vector<std::vector<double>> correlate(const Level& level, const std::vector<std::shared_ptr<VideoFrame>>& frames, const std::vector<std::size_t>& references, ThreadPool& threadPool, VideoFrame::Optimization optimization) const;
+
+  std::size_t m_size;
+  std::size_t m_width;
+  std::size_t m_height;
+  std::size_t m_channels;
+  Level       m_full;
+  Level       m_coarse;
+};
+
+#endif
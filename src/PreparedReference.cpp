@@ -0,0 +1,78 @@
+#include "PreparedReference.h"
+
+#include "EmbedKernels.h"
+
+PreparedReference::PreparedReference(std::shared_ptr<VideoFrame> preference, double alpha):
+  m_width(preference ? preference->width() : 0),
+  m_height(preference ? preference->height() : 0),
+  m_stride(0),
+  m_channels(preference ? preference->channels() : 1),
+  m_colorFormat(preference ? preference->colorFormat() : VideoFrame::Grayscale),
+  m_alpha(alpha),
+  m_sum(),
+  m_sumOfSquares()
+{
+  std::size_t rowBytes = m_width * m_channels;
+  m_stride = alignedStride(rowBytes);
+  m_data.assign(m_stride * m_height, 0);
+
+  if (!preference)
+    return;
+
+  EmbedKernels::scale(preference->data(0), preference->stride(0), m_data.data(), m_stride, rowBytes, m_height, EmbedKernels::makeGain(alpha));
+
+  for (std::size_t i = 0; i < m_height; i++)
+  {
+    const uint8_t* prow = m_data.data() + i * m_stride;
+    for (std::size_t j = 0; j < rowBytes; j++)
+    {
+      m_sum[j % m_channels] += prow[j];
+      m_sumOfSquares[j % m_channels] += prow[j] * prow[j];
+    }
+  }
+}
+
+std::size_t PreparedReference::width() const
+{
+  return m_width;
+}
+
+std::size_t PreparedReference::height() const
+{
+  return m_height;
+}
+
+std::size_t PreparedReference::stride() const
+{
+  return m_stride;
+}
+
+std::size_t PreparedReference::channels() const
+{
+  return m_channels;
+}
+
+VideoFrame::ColorFormat PreparedReference::colorFormat() const
+{
+  return m_colorFormat;
+}
+
+double PreparedReference::alpha() const
+{
+  return m_alpha;
+}
+
+const uint8_t* PreparedReference::data() const
+{
+  return m_data.data();
+}
+
+uint64_t PreparedReference::sum(std::size_t channel) const
+{
+  return m_sum[channel];
+}
+
+uint64_t PreparedReference::sumOfSquares(std::size_t channel) const
+{
+  return m_sumOfSquares[channel];
+}
@@ -0,0 +1,43 @@
+#ifndef PREPARED_REFERENCE_H_
+#define PREPARED_REFERENCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "AlignedAllocator.h"
+#include "VideoFrame.h"
+
+// Watermark reference scaled by alpha once and kept in an aligned, stride-padded
+// plane together with its per-channel statistics, so it can be embedded into
+// (or detected in) any number of frames without repeating that work.
+// Statistics describe the scaled values: prepare with alpha 1.0 for detection.
+class PreparedReference
+{
+public:
+  PreparedReference(std::shared_ptr<VideoFrame> preference, double alpha = 1.0);
+
+  std::size_t width() const;
+  std::size_t height() const;
+  std::size_t stride() const;
+  std::size_t channels() const;
+  VideoFrame::ColorFormat colorFormat() const;
+  double alpha() const;
+  const uint8_t* data() const;
+
+  uint64_t sum(std::size_t channel) const;
+  uint64_t sumOfSquares(std::size_t channel) const;
+
+private:
+  std::size_t             m_width;
+  std::size_t             m_height;
+  std::size_t             m_stride;
+  std::size_t             m_channels;
+  VideoFrame::ColorFormat m_colorFormat;
+  double                  m_alpha;
+  AlignedBuffer           m_data;
+  uint64_t                m_sum[3];
+  uint64_t                m_sumOfSquares[3];
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "ProceduralReference.h"
+
+#include "GeneratorKernels.h"
+#include "WatermarkReference.h"
+
+ProceduralReference::ProceduralReference(std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, VideoFrame::ColorFormat colorFormat):
+  m_width(width),
+  m_height(height),
+  m_colorFormat(colorFormat),
+  m_threshold(threshold),
+  m_key(key)
+{
+}
+
+std::size_t ProceduralReference::width() const
+{
+  return m_width;
+}
+
+std::size_t ProceduralReference::height() const
+{
+  return m_height;
+}
+
+std::size_t ProceduralReference::channels() const
+{
+  return m_colorFormat == VideoFrame::Color ? 3 : 1;
+}
+
+VideoFrame::ColorFormat ProceduralReference::colorFormat() const
+{
+  return m_colorFormat;
+}
+
+uint8_t ProceduralReference::threshold() const
+{
+  return m_threshold;
+}
+
+uint64_t ProceduralReference::key() const
+{
+  return m_key;
+}
+
+void ProceduralReference::generate(uint8_t* pdst, std::size_t row, std::size_t column, std::size_t bytes, VideoFrame::Optimization optimization) const
+{
+  GeneratorKernels::generate(pdst, m_key, (uint32_t)row, column, bytes, m_threshold, optimization);
+}
+
+std::shared_ptr<VideoFrame> ProceduralReference::materialize() const
+{
+  return WR::createRandom(m_width, m_height, m_threshold, m_key, m_colorFormat);
+}
@@ -0,0 +1,41 @@
+#ifndef PROCEDURAL_REFERENCE_H_
+#define PROCEDURAL_REFERENCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "VideoFrame.h"
+
+// Watermark reference described only by its key. The pattern of
+// WR::createRandom(width, height, threshold, key, colorFormat) is regenerated
+// tile by tile inside the embed and detect loops, so it takes no resident
+// memory and those loops read only the frame.
+class ProceduralReference
+{
+public:
+  ProceduralReference(std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, VideoFrame::ColorFormat colorFormat = VideoFrame::Color);
+
+  std::size_t width() const;
+  std::size_t height() const;
+  std::size_t channels() const;
+  VideoFrame::ColorFormat colorFormat() const;
+  uint8_t threshold() const;
+  uint64_t key() const;
+
+  // Writes `bytes` bytes of plane 0 starting at byte `column` of row `row`.
+  // The optimization must already be resolved with VideoFrame::resolveOptimization.
+  void generate(uint8_t* pdst, std::size_t row, std::size_t column, std::size_t bytes, VideoFrame::Optimization optimization) const;
+
+  // the same reference stored in a frame
+  std::shared_ptr<VideoFrame> materialize() const;
+
+private:
+  std::size_t             m_width;
+  std::size_t             m_height;
+  VideoFrame::ColorFormat m_colorFormat;
+  uint8_t                 m_threshold;
+  uint64_t                m_key;
+};
+
+#endif
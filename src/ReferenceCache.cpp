@@ -0,0 +1,246 @@
+#include "ReferenceCache.h"
+#include "WatermarkReference.h"
+#include "PreparedReference.h"
+
+#include <vector>
+
+namespace
+{
+  std::size_t frameBytes(const VideoFrame& frame)
+  {
+    std::size_t bytes = 0;
+    for (std::size_t plane = 0; plane < frame.planes(); plane++)
+      bytes += frame.stride((int)plane) * frame.planeHeight((int)plane);
+    return bytes;
+  }
+
+  std::size_t pixelBytes(const VideoFrame& frame, int plane)
+  {
+    if (plane == 0)
+      return frame.channels();
+    return frame.colorFormat() == VideoFrame::NV12 ? 2 : 1;
+  }
+
+  std::size_t planeWidth(const VideoFrame& frame, int plane)
+  {
+    return plane == 0 ? frame.width() : (frame.width() + 1) / 2;
+  }
+
+  std::shared_ptr<VideoFrame> rescale(const VideoFrame& source, std::size_t width, std::size_t height)
+  {
+    auto pframe = std::make_shared<VideoFrame>(width, height, source.colorFormat());
+    for (int plane = 0; plane < (int)pframe->planes(); plane++)
+    {
+      std::size_t bytes = pixelBytes(source, plane);
+      std::size_t srcWidth = planeWidth(source, plane);
+      std::size_t dstWidth = planeWidth(*pframe, plane);
+
+      std::vector<std::size_t> columns(dstWidth);
+      for (std::size_t j = 0; j < dstWidth; j++)
+        columns[j] = j * srcWidth / dstWidth * bytes;
+
+      for (std::size_t i = 0; i < pframe->planeHeight(plane); i++)
+      {
+        const uint8_t* psrc = source.data(plane) + i * source.planeHeight(plane) / pframe->planeHeight(plane) * source.stride(plane);
+        uint8_t* pdst = pframe->data(plane) + i * pframe->stride(plane);
+        for (std::size_t j = 0; j < dstWidth; j++)
+        {
+          for (std::size_t c = 0; c < bytes; c++)
+            pdst[j * bytes + c] = psrc[columns[j] + c];
+        }
+      }
+    }
+    return pframe;
+  }
+}
+
+ReferenceCache::ReferenceCache(std::size_t budget, Generator generator):
+  m_budget(budget),
+  m_generator(generator),
+  m_bytes(0),
+  m_hits(0),
+  m_misses(0)
+{
+}
+
+ReferenceCache::Generator ReferenceCache::random(uint8_t threshold, VideoFrame::Optimization optimization)
+{
+  return [threshold, optimization](uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat)
+  {
+    return WR::createRandom(width, height, threshold, key, colorFormat, optimization);
+  };
+}
+
+ReferenceCache::Generator ReferenceCache::rescaled(const std::map<uint64_t, std::shared_ptr<VideoFrame>>& sources)
+{
+  return [sources](uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat) -> std::shared_ptr<VideoFrame>
+  {
+    auto it = sources.find(key);
+    if (it == sources.end() || it->second->colorFormat() != colorFormat || !it->second->width() || !it->second->height())
+      return nullptr;
+    if (it->second->width() == width && it->second->height() == height)
+      return it->second;
+    return rescale(*it->second, width, height);
+  };
+}
+
+std::shared_ptr<VideoFrame> ReferenceCache::reference(uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat)
+{
+  return frame(Key(key, width, height, (int)colorFormat, false, 0.0), true);
+}
+
+std::shared_ptr<PreparedReference> ReferenceCache::prepared(uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, double alpha)
+{
+  Key itemKey(key, width, height, (int)colorFormat, true, alpha);
+  Item item;
+  std::promise<Item> promise;
+  if (lookup(itemKey, item, promise, true))
+    return item.prepared;
+
+  // the reference itself is part of this call and not counted again
+  try
+  {
+    auto pframe = frame(Key(key, width, height, (int)colorFormat, false, 0.0), false);
+    if (pframe)
+    {
+      item.prepared = std::make_shared<PreparedReference>(pframe, alpha);
+      item.bytes = item.prepared->stride() * item.prepared->height();
+    }
+  }
+  catch (...)
+  {
+    abandon(itemKey, promise);
+    throw;
+  }
+
+  insert(itemKey, item, promise);
+  return item.prepared;
+}
+
+std::shared_ptr<VideoFrame> ReferenceCache::frame(const Key& key, bool count)
+{
+  Item item;
+  std::promise<Item> promise;
+  if (lookup(key, item, promise, count))
+    return item.frame;
+
+  try
+  {
+    item.frame = m_generator(std::get<0>(key), std::get<1>(key), std::get<2>(key), (VideoFrame::ColorFormat)std::get<3>(key));
+    if (item.frame)
+      item.bytes = frameBytes(*item.frame);
+  }
+  catch (...)
+  {
+    abandon(key, promise);
+    throw;
+  }
+
+  insert(key, item, promise);
+  return item.frame;
+}
+
+bool ReferenceCache::lookup(const Key& key, Item& item, std::promise<Item>& promise, bool count)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto it = m_items.find(key);
+  if (it != m_items.end())
+  {
+    if (count)
+      m_hits++;
+    m_order.splice(m_order.begin(), m_order, it->second.position);
+    item = it->second;
+    return true;
+  }
+
+  auto pending = m_pending.find(key);
+  if (pending != m_pending.end())
+  {
+    if (count)
+      m_hits++;
+    std::shared_future<Item> future = pending->second;
+    lock.unlock();
+    item = future.get();
+    return true;
+  }
+
+  if (count)
+    m_misses++;
+  m_pending[key] = promise.get_future().share();
+  return false;
+}
+
+void ReferenceCache::insert(const Key& key, Item& item, std::promise<Item>& promise)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pending.erase(key);
+
+    // failed generations and entries larger than the whole budget are handed
+    // out but not kept
+    if ((item.frame || item.prepared) && item.bytes <= m_budget && m_items.find(key) == m_items.end())
+    {
+      while (m_bytes + item.bytes > m_budget)
+      {
+        auto last = m_items.find(m_order.back());
+        m_bytes -= last->second.bytes;
+        m_items.erase(last);
+        m_order.pop_back();
+      }
+
+      m_order.push_front(key);
+      item.position = m_order.begin();
+      m_items[key] = item;
+      m_bytes += item.bytes;
+    }
+  }
+
+  promise.set_value(item);
+}
+
+void ReferenceCache::abandon(const Key& key, std::promise<Item>& promise)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_pending.erase(key);
+  }
+
+  promise.set_exception(std::current_exception());
+}
+
+void ReferenceCache::clear()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_items.clear();
+  m_order.clear();
+  m_bytes = 0;
+}
+
+std::size_t ReferenceCache::budget() const
+{
+  return m_budget;
+}
+
+std::size_t ReferenceCache::bytes() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_bytes;
+}
+
+std::size_t ReferenceCache::entries() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_items.size();
+}
+
+std::size_t ReferenceCache::hits() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_hits;
+}
+
+std::size_t ReferenceCache::misses() const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_misses;
+}
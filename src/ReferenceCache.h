@@ -0,0 +1,87 @@
+#ifndef REFERENCE_CACHE_H_
+#define REFERENCE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "VideoFrame.h"
+
+class PreparedReference;
+
+// Keeps the references of recently used (key, width, height, format)
+// combinations, so streams mixing resolutions get a reference of the frame
+// size without generating it again for every frame. Entries are evicted least
+// recently used first once they take more than the byte budget; references
+// already handed out stay valid. Thread safe: concurrent misses on the same
+// entry wait for the one thread generating it.
+class ReferenceCache
+{
+public:
+  // Creates the reference for a key and geometry on a miss, nullptr if there is none.
+  // An exception it throws reaches the calling thread and the calls waiting for
+  // the same entry; the entry is not cached and the next call generates it again.
+  typedef std::function<std::shared_ptr<VideoFrame>(uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat)> Generator;
+
+  ReferenceCache(std::size_t budget, Generator generator);
+
+  // WR::createRandom with the key
+  static Generator random(uint8_t threshold, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  // Nearest neighbour rescale of the reference of the key, which keeps the
+  // value distribution of the reference. The format must match.
+  static Generator rescaled(const std::map<uint64_t, std::shared_ptr<VideoFrame>>& sources);
+
+  std::shared_ptr<VideoFrame> reference(uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat);
+  // the reference prepared with alpha, cached separately from the reference itself
+  std::shared_ptr<PreparedReference> prepared(uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, double alpha = 1.0);
+
+  void clear();
+  std::size_t budget() const;
+  // bytes taken by the cached entries
+  std::size_t bytes() const;
+  std::size_t entries() const;
+  // Every call counts once: a miss when it generated the entry, a hit when the
+  // entry was cached or generated by a concurrent call
+  std::size_t hits() const;
+  std::size_t misses() const;
+
+private:
+  // key, width, height, format, prepared, alpha
+  typedef std::tuple<uint64_t, std::size_t, std::size_t, int, bool, double> Key;
+
+  struct Item
+  {
+    std::shared_ptr<VideoFrame>        frame;
+    std::shared_ptr<PreparedReference> prepared;
+    std::size_t                        bytes;
+    std::list<Key>::iterator           position;
+  };
+
+  std::shared_ptr<VideoFrame> frame(const Key& key, bool count);
+  // Finds the cached entry or waits for its concurrent generation. Otherwise
+  // marks it as in flight and returns false; the caller then generates it and
+  // hands it to insert, which also passes it on to the waiting calls.
+  bool lookup(const Key& key, Item& item, std::promise<Item>& promise, bool count);
+  void insert(const Key& key, Item& item, std::promise<Item>& promise);
+  // Called from the handler of an exception thrown while generating: the entry
+  // is no longer in flight and the waiting calls get the exception
+  void abandon(const Key& key, std::promise<Item>& promise);
+
+  std::size_t          m_budget;
+  Generator            m_generator;
+  std::size_t          m_bytes;
+  std::size_t          m_hits;
+  std::size_t          m_misses;
+  std::list<Key>       m_order;  //most recently used first
+  std::map<Key, Item>  m_items;
+  std::map<Key, std::shared_future<Item>> m_pending;  //entries being generated
+  mutable std::mutex   m_mutex;
+};
+
+#endif
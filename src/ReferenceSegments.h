@@ -0,0 +1,30 @@
+#ifndef REFERENCE_SEGMENTS_H_
+#define REFERENCE_SEGMENTS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "VideoFrame.h"
+#include "ProceduralReference.h"
+#include "CompactReference.h"
+
+// Procedural and compact references are produced row segment by row segment
+// into an L1 tile by both the embed and the detect loops. Both must use the
+// same segments to stay bit exact.
+namespace ReferenceSegments
+{
+  // Segments are a multiple of the 3 interleaved channels and of 64 bytes.
+  const std::size_t segmentBytes = 4032;
+
+  inline void fillSegment(const ProceduralReference& reference, uint8_t* pdst, std::size_t row, std::size_t column, std::size_t bytes, VideoFrame::Optimization optimization)
+  {
+    reference.generate(pdst, row, column, bytes, optimization);
+  }
+
+  inline void fillSegment(const CompactReference& reference, uint8_t* pdst, std::size_t row, std::size_t column, std::size_t bytes, VideoFrame::Optimization optimization)
+  {
+    reference.decode(pdst, row, column, bytes, optimization);
+  }
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include "ReferenceStore.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  const char        magic[8] = { 'W', 'R', 'S', 'T', 'O', 'R', 'E', '1' };
+  const uint32_t    version = 1;
+  const std::size_t alignment = 64;
+  const std::size_t maxPlanes = 3;
+
+  struct Header
+  {
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;
+  };
+
+  struct DirectoryRecord
+  {
+    uint64_t key;
+    uint32_t width;
+    uint32_t height;
+    uint32_t colorFormat;
+    uint32_t planes;
+    uint64_t offsets[maxPlanes];
+    uint64_t strides[maxPlanes];
+  };
+
+  std::size_t planeCount(VideoFrame::ColorFormat colorFormat)
+  {
+    return colorFormat == VideoFrame::I420 ? 3 : colorFormat == VideoFrame::NV12 ? 2 : 1;
+  }
+
+  std::size_t rowBytes(VideoFrame::ColorFormat colorFormat, std::size_t width, std::size_t plane)
+  {
+    if (colorFormat == VideoFrame::Color)
+      return width * 3;
+    if (plane == 0)
+      return width;
+    return colorFormat == VideoFrame::NV12 ? (width + 1) / 2 * 2 : (width + 1) / 2;
+  }
+
+  std::size_t planeHeight(std::size_t height, std::size_t plane)
+  {
+    return plane == 0 ? height : (height + 1) / 2;
+  }
+
+  std::size_t alignUp(std::size_t value)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+}
+
+struct ReferenceStore::Mapping
+{
+  uint8_t*    data = nullptr;
+  std::size_t size = 0;
+#ifdef _WIN32
+  HANDLE      file = INVALID_HANDLE_VALUE;
+  HANDLE      mapping = nullptr;
+#endif
+
+  bool map(const std::string& fileName)
+  {
+#ifdef _WIN32
+    file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Header))
+      return false;
+    size = (std::size_t)fileSize.QuadPart;
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (!mapping)
+      return false;
+
+    data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    return data != nullptr;
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(Header))
+    {
+      ::close(fd);
+      return false;
+    }
+    size = (std::size_t)status.st_size;
+
+    // private writable pages: frames may be modified without touching the file
+    void* pdata = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (pdata == MAP_FAILED)
+      return false;
+
+    data = (uint8_t*)pdata;
+    return true;
+#endif
+  }
+
+  ~Mapping()
+  {
+#ifdef _WIN32
+    if (data)
+      UnmapViewOfFile(data);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+#else
+    if (data)
+      munmap(data, size);
+#endif
+  }
+};
+
+bool ReferenceStore::write(const std::string& fileName, const std::vector<Entry>& entries)
+{
+  std::vector<DirectoryRecord> directory(entries.size());
+  std::size_t offset = alignUp(sizeof(Header) + sizeof(DirectoryRecord) * entries.size());
+  for (std::size_t i = 0; i < entries.size(); i++)
+  {
+    const VideoFrame& frame = *entries[i].frame;
+    DirectoryRecord& record = directory[i];
+    std::memset(&record, 0, sizeof(record));
+    record.key = entries[i].key;
+    record.width = (uint32_t)frame.width();
+    record.height = (uint32_t)frame.height();
+    record.colorFormat = (uint32_t)frame.colorFormat();
+    record.planes = (uint32_t)frame.planes();
+
+    for (std::size_t plane = 0; plane < frame.planes(); plane++)
+    {
+      record.offsets[plane] = offset;
+      record.strides[plane] = frame.stride((int)plane);
+      offset = alignUp(offset + frame.stride((int)plane) * frame.planeHeight((int)plane));
+    }
+  }
+
+  std::ofstream stream(fileName, std::ios::binary);
+  if (!stream)
+    return false;
+
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.count = (uint32_t)entries.size();
+  stream.write((const char*)&header, sizeof(header));
+  stream.write((const char*)directory.data(), sizeof(DirectoryRecord) * directory.size());
+
+  const char padding[alignment] = {};
+  for (std::size_t i = 0; i < entries.size(); i++)
+  {
+    const VideoFrame& frame = *entries[i].frame;
+    for (std::size_t plane = 0; plane < frame.planes(); plane++)
+    {
+      stream.write(padding, directory[i].offsets[plane] - (std::size_t)stream.tellp());
+      stream.write((const char*)frame.data((int)plane), frame.stride((int)plane) * frame.planeHeight((int)plane));
+    }
+  }
+
+  return (bool)stream;
+}
+
+bool ReferenceStore::merge(const std::string& fileName, const std::vector<Entry>& entries)
+{
+  std::vector<Entry> merged;
+  if (std::ifstream(fileName))
+  {
+    ReferenceStore store;
+    if (!store.open(fileName))
+      return false;
+
+    for (std::size_t i = 0; i < store.size(); i++)
+    {
+      Info info = store.info(i);
+      bool replaced = std::any_of(entries.begin(), entries.end(), [&](const Entry& entry)
+      {
+        return entry.key == info.key && entry.frame->width() == info.width && entry.frame->height() == info.height && entry.frame->colorFormat() == info.colorFormat;
+      });
+      if (!replaced)
+        merged.push_back({ info.key, store.frame(i) });
+    }
+  }
+  merged.insert(merged.end(), entries.begin(), entries.end());
+
+  std::string tempName = fileName + ".tmp";
+  bool res = write(tempName, merged);
+  merged.clear();
+  if (!res)
+  {
+    std::remove(tempName.c_str());
+    return false;
+  }
+
+#ifdef _WIN32
+  // rename does not replace existing files on Windows
+  std::remove(fileName.c_str());
+#endif
+  return std::rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+
+bool ReferenceStore::open(const std::string& fileName)
+{
+  close();
+
+  auto pmapping = std::make_shared<Mapping>();
+  if (!pmapping->map(fileName))
+    return false;
+
+  Header header;
+  std::memcpy(&header, pmapping->data, sizeof(header));
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version)
+    return false;
+  if (header.count > (pmapping->size - sizeof(Header)) / sizeof(DirectoryRecord))
+    return false;
+
+  std::vector<Record> records(header.count);
+  for (std::size_t i = 0; i < header.count; i++)
+  {
+    DirectoryRecord record;
+    std::memcpy(&record, pmapping->data + sizeof(Header) + i * sizeof(DirectoryRecord), sizeof(record));
+
+    if (record.colorFormat > VideoFrame::NV12)
+      return false;
+    VideoFrame::ColorFormat colorFormat = (VideoFrame::ColorFormat)record.colorFormat;
+    if (record.planes != planeCount(colorFormat))
+      return false;
+
+    records[i].info = { record.key, record.width, record.height, colorFormat };
+    for (std::size_t plane = 0; plane < record.planes; plane++)
+    {
+      uint64_t offset = record.offsets[plane];
+      uint64_t stride = record.strides[plane];
+      uint64_t height = planeHeight(record.height, plane);
+      if (offset % alignment || stride < rowBytes(colorFormat, record.width, plane) || offset > pmapping->size)
+        return false;
+      if (stride && height > (pmapping->size - offset) / stride)
+        return false;
+
+      records[i].offsets.push_back((std::size_t)offset);
+      records[i].strides.push_back((std::size_t)stride);
+    }
+  }
+
+  m_mapping = pmapping;
+  m_records = std::move(records);
+  return true;
+}
+
+void ReferenceStore::close()
+{
+  m_mapping.reset();
+  m_records.clear();
+}
+
+std::size_t ReferenceStore::size() const
+{
+  return m_records.size();
+}
+
+ReferenceStore::Info ReferenceStore::info(std::size_t index) const
+{
+  return m_records[index].info;
+}
+
+std::shared_ptr<VideoFrame> ReferenceStore::frame(std::size_t index) const
+{
+  const Record& record = m_records[index];
+
+  std::vector<uint8_t*> planes;
+  for (std::size_t offset : record.offsets)
+    planes.push_back(m_mapping->data + offset);
+
+  return std::make_shared<VideoFrame>(record.info.width, record.info.height, record.info.colorFormat, planes, record.strides, m_mapping);
+}
+
+std::shared_ptr<VideoFrame> ReferenceStore::find(uint64_t key, std::size_t width, std::size_t height) const
+{
+  for (std::size_t i = 0; i < m_records.size(); i++)
+  {
+    const Info& info = m_records[i].info;
+    if (info.key == key && (!width || info.width == width) && (!height || info.height == height))
+      return frame(i);
+  }
+  return nullptr;
+}
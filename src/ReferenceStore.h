@@ -0,0 +1,69 @@
+#ifndef REFERENCE_STORE_H_
+#define REFERENCE_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "VideoFrame.h"
+
+// Binary file holding several references, for example one per key or
+// resolution. A 16-byte header ("WRSTORE1", version, entry count) is followed
+// by one directory record per entry and the raw planes, each starting on a
+// 64-byte boundary with the stride of a VideoFrame. Values are stored in the
+// byte order of the writer.
+//
+// open() maps the file copy on write, so frames returned by frame() and find()
+// point straight into the mapping: nothing is read until a page is touched,
+// and writes to a frame never reach the file. The frames keep the mapping
+// alive after the store is closed or destroyed.
+class ReferenceStore
+{
+public:
+  struct Entry
+  {
+    uint64_t                    key;
+    std::shared_ptr<VideoFrame> frame;
+  };
+
+  struct Info
+  {
+    uint64_t                key;
+    std::size_t             width;
+    std::size_t             height;
+    VideoFrame::ColorFormat colorFormat;
+  };
+
+  static bool write(const std::string& fileName, const std::vector<Entry>& entries);
+  // Adds the entries to the store in the file, or creates it. Stored entries
+  // with the key, size and format of a new one are replaced. The file is
+  // rewritten through a temporary file, frames of the old file stay valid.
+  static bool merge(const std::string& fileName, const std::vector<Entry>& entries);
+
+  // false if the file is missing or its directory does not fit the file
+  bool open(const std::string& fileName);
+  void close();
+
+  std::size_t size() const;
+  Info info(std::size_t index) const;
+  std::shared_ptr<VideoFrame> frame(std::size_t index) const;
+  // first entry with the key and, unless they are 0, the given size; nullptr if there is none
+  std::shared_ptr<VideoFrame> find(uint64_t key, std::size_t width = 0, std::size_t height = 0) const;
+
+private:
+  struct Mapping;
+
+  struct Record
+  {
+    Info                     info;
+    std::vector<std::size_t> offsets;
+    std::vector<std::size_t> strides;
+  };
+
+  std::shared_ptr<Mapping> m_mapping;
+  std::vector<Record>      m_records;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "TemporalDetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+TemporalDetector::TemporalDetector(std::shared_ptr<VideoFrame> preference, std::size_t window, double threshold, VideoFrame::Optimization optimization):
+  m_reference(preference),
+  m_window(std::max<std::size_t>(1, window)),
+  m_threshold(threshold),
+  m_optimization(optimization),
+  m_channels(preference ? preference->channels() : 1),
+  m_history(m_window),
+  m_next(0),
+  m_frames(0),
+  m_total()
+{
+}
+
+Detector::Result TemporalDetector::push(std::shared_ptr<VideoFrame> pFrame)
+{
+  ThreadPool threadPool(0);
+  return push(pFrame, threadPool);
+}
+
+Detector::Result TemporalDetector::push(std::shared_ptr<VideoFrame> pFrame, ThreadPool& threadPool)
+{
+  Detector::Moments moments;
+  if (!Detector::computeMoments(pFrame, m_reference, moments, threadPool, m_optimization))
+    return Detector::FAILED;
+
+  if (m_frames == m_window)
+    add(m_history[m_next], -1.0);
+  else
+    m_frames++;
+
+  m_history[m_next] = evidence(moments);
+  add(m_history[m_next], 1.0);
+  m_next = (m_next + 1) % m_window;
+
+  // subtracting old frames leaves rounding residue, so the totals are
+  // recomputed from the window once per rotation
+  if (m_next == 0)
+    resum();
+
+  return result();
+}
+
+Detector::Result TemporalDetector::result() const
+{
+  if (m_frames == 0)
+    return Detector::NO_WATERMARK;
+
+  double corr = correlation();
+  if (corr < -m_threshold)
+    return Detector::FALSE;
+  else if (corr > m_threshold)
+    return Detector::TRUE;
+
+  return Detector::NO_WATERMARK;
+}
+
+double TemporalDetector::correlation() const
+{
+  double corr = 0;
+  for (std::size_t channel = 0; channel < m_channels; channel++)
+    corr += m_total.cross[channel] / std::sqrt(m_total.varianceF[channel]) / std::sqrt(m_total.varianceN[channel]);
+
+  return corr / m_channels;
+}
+
+std::size_t TemporalDetector::frames() const
+{
+  return m_frames;
+}
+
+void TemporalDetector::reset()
+{
+  m_next = 0;
+  m_frames = 0;
+  m_total = Evidence();
+}
+
+TemporalDetector::Evidence TemporalDetector::evidence(const Detector::Moments& moments) const
+{
+  // Centering every frame separately keeps brightness changes between frames
+  // out of the pooled correlation
+  Evidence res = Evidence();
+  double count = (double)moments.count;
+  for (std::size_t channel = 0; channel < m_channels; channel++)
+  {
+    double sumF = (double)moments.sumF[channel];
+    double sumN = (double)moments.sumN[channel];
+    res.cross[channel] = (double)moments.sumFN[channel] - sumF * sumN / count;
+    res.varianceF[channel] = (double)moments.sumFF[channel] - sumF * sumF / count;
+    res.varianceN[channel] = (double)moments.sumNN[channel] - sumN * sumN / count;
+  }
+  return res;
+}
+
+void TemporalDetector::add(const Evidence& evidence, double sign)
+{
+  for (std::size_t channel = 0; channel < 3; channel++)
+  {
+    m_total.cross[channel] += sign * evidence.cross[channel];
+    m_total.varianceF[channel] += sign * evidence.varianceF[channel];
+    m_total.varianceN[channel] += sign * evidence.varianceN[channel];
+  }
+}
+
+void TemporalDetector::resum()
+{
+  m_total = Evidence();
+  for (std::size_t frame = 0; frame < m_frames; frame++)
+    add(m_history[frame], 1.0);
+}
@@ -0,0 +1,56 @@
+#ifndef TEMPORAL_DETECTOR_H_
+#define TEMPORAL_DETECTOR_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "Detector.h"
+#include "VideoFrame.h"
+
+// Accumulates detection evidence over a sliding window of video frames that
+// carry the same embedded value. Each frame is scanned once; only its centered
+// sums are kept, so the state does not depend on the frame size and a weak
+// watermark becomes detectable once enough frames have been seen.
+class TemporalDetector
+{
+public:
+  TemporalDetector(std::shared_ptr<VideoFrame> preference, std::size_t window, double threshold, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // Adds a frame and returns the decision over the last `window` frames.
+  // Frames that do not match the reference return FAILED and are not added.
+  Detector::Result push(std::shared_ptr<VideoFrame> pFrame);
+  Detector::Result push(std::shared_ptr<VideoFrame> pFrame, ThreadPool& threadPool);
+
+  Detector::Result result() const;
+  // pooled correlation of the frames in the window
+  double correlation() const;
+  std::size_t frames() const;
+  void reset();
+
+private:
+  // per channel sums of the frame with its own mean removed
+  struct Evidence
+  {
+    double cross[3];
+    double varianceF[3];
+    double varianceN[3];
+  };
+
+  Evidence evidence(const Detector::Moments& moments) const;
+  void add(const Evidence& evidence, double sign);
+  void resum();
+
+  std::shared_ptr<VideoFrame>  m_reference;
+  std::size_t                  m_window;
+  double                       m_threshold;
+  VideoFrame::Optimization     m_optimization;
+  std::size_t                  m_channels;
+
+  std::vector<Evidence>        m_history;  //ring buffer of the frames in the window
+  std::size_t                  m_next;
+  std::size_t                  m_frames;
+  Evidence                     m_total;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "TiledReference.h"
+
+#include <algorithm>
+#include <cstring>
+
+TiledReference::TiledReference(std::shared_ptr<VideoFrame> ptile):
+  m_width(ptile ? ptile->width() : 0),
+  m_height(ptile ? ptile->height() : 0),
+  m_channels(ptile ? ptile->channels() : 1),
+  m_colorFormat(ptile ? ptile->colorFormat() : VideoFrame::Grayscale),
+  m_segmentBytes(0),
+  m_stride(0)
+{
+  const std::size_t minSegmentBytes = 1024;
+
+  std::size_t rowBytes = m_width * m_channels;
+  if (rowBytes == 0 || m_height == 0)
+    return;
+
+  m_segmentBytes = (minSegmentBytes + rowBytes - 1) / rowBytes * rowBytes;
+  m_stride = alignedStride(m_segmentBytes);
+  m_data.assign(m_stride * m_height, 0);
+
+  for (std::size_t i = 0; i < m_height; i++)
+  {
+    for (std::size_t j = 0; j < m_segmentBytes; j += rowBytes)
+      std::memcpy(m_data.data() + i * m_stride + j, ptile->data(0) + i * ptile->stride(0), rowBytes);
+  }
+}
+
+std::size_t TiledReference::width() const
+{
+  return m_width;
+}
+
+std::size_t TiledReference::height() const
+{
+  return m_height;
+}
+
+std::size_t TiledReference::channels() const
+{
+  return m_channels;
+}
+
+VideoFrame::ColorFormat TiledReference::colorFormat() const
+{
+  return m_colorFormat;
+}
+
+const uint8_t* TiledReference::row(std::size_t y) const
+{
+  return m_data.data() + y % m_height * m_stride;
+}
+
+std::size_t TiledReference::stride() const
+{
+  return m_stride;
+}
+
+std::size_t TiledReference::segmentBytes() const
+{
+  return m_segmentBytes;
+}
+
+std::shared_ptr<VideoFrame> TiledReference::materialize(std::size_t width, std::size_t height) const
+{
+  auto pframe = std::make_shared<VideoFrame>(width, height, m_colorFormat);
+  if (m_segmentBytes == 0)
+    return pframe;
+
+  std::size_t rowBytes = width * m_channels;
+  for (std::size_t i = 0; i < height; i++)
+  {
+    for (std::size_t j = 0; j < rowBytes; j += m_segmentBytes)
+      std::memcpy(pframe->data(0) + i * pframe->stride(0) + j, row(i), std::min(m_segmentBytes, rowBytes - j));
+  }
+  return pframe;
+}
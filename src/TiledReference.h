@@ -0,0 +1,47 @@
+#ifndef TILED_REFERENCE_H_
+#define TILED_REFERENCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "AlignedAllocator.h"
+#include "VideoFrame.h"
+
+// Watermark reference given by a small tile repeated over the frame: pixel
+// (x, y) of a frame of any size uses tile pixel (x % width(), y % height()).
+// Each tile row is stored repeated to about 1 KB, so the embed and detect
+// kernels run over whole segments without wrapping, and the tile stays in L1
+// or L2 for every resolution.
+class TiledReference
+{
+public:
+  TiledReference(std::shared_ptr<VideoFrame> ptile);
+
+  // size of the tile
+  std::size_t width() const;
+  std::size_t height() const;
+  std::size_t channels() const;
+  VideoFrame::ColorFormat colorFormat() const;
+
+  // Tile row y % height() repeated to segmentBytes() bytes. Consecutive tile
+  // rows are stride() bytes apart.
+  const uint8_t* row(std::size_t y) const;
+  std::size_t stride() const;
+  // a whole number of tile rows
+  std::size_t segmentBytes() const;
+
+  // the reference repeated over a frame of the given size
+  std::shared_ptr<VideoFrame> materialize(std::size_t width, std::size_t height) const;
+
+private:
+  std::size_t             m_width;
+  std::size_t             m_height;
+  std::size_t             m_channels;
+  VideoFrame::ColorFormat m_colorFormat;
+  std::size_t             m_segmentBytes;
+  std::size_t             m_stride;
+  AlignedBuffer           m_data;
+};
+
+#endif
@@ -1,49 +1,306 @@
 #include "VideoFrame.h"
 
+#include "CpuFeatures.h"
+#include "EmbedKernels.h"
+#include "DCTKernels.h"
+#include "GeneratorKernels.h"
+#include "PreparedReference.h"
+#include "ProceduralReference.h"
+#include "TiledReference.h"
+#include "CompactReference.h"
+#include "ReferenceSegments.h"
+#include "FramePool.h"
+#include "AutoTuner.h"
+
 #include <opencv2/opencv.hpp>
-#ifdef WIN32
-#include <intrin.h>
-#endif
 
 VideoFrame::VideoFrame(std::size_t width, std::size_t height, ColorFormat colorFormat):
   m_width(width),
   m_height(height),
   m_colorFormat(colorFormat)
 {
-  std::size_t size = m_width * m_height;
-
-  if (m_colorFormat == ColorFormat::Color)
-    size *= 3;
+  allocate(true);
+}
 
-  m_data.resize(1);
-  m_data[0].resize(size);
+VideoFrame::VideoFrame(std::size_t width, std::size_t height, ColorFormat colorFormat, std::shared_ptr<FramePool> pool):
+  m_width(width),
+  m_height(height),
+  m_colorFormat(colorFormat),
+  m_pool(pool)
+{
+  allocate(!m_pool);
 }
 
-VideoFrame::VideoFrame(const std::string& fileName, ColorFormat colorFormat):
+VideoFrame::VideoFrame(const std::string& fileName, ColorFormat colorFormat, std::shared_ptr<FramePool> pool):
   m_width(0),
   m_height(0),
-  m_colorFormat(colorFormat)
+  m_colorFormat(colorFormat),
+  m_pool(pool)
 {
   cv::Mat image;
-  image = cv::imread(fileName, m_colorFormat == ColorFormat::Color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE);
+  image = cv::imread(fileName, m_colorFormat == ColorFormat::Grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
 
   m_width = image.cols;
   m_height = image.rows;
 
-  std::size_t size = m_width * m_height;
-  if (m_colorFormat == ColorFormat::Color)
-    size *= 3;
+  allocate(!m_pool);
+
+  if (!isYUV())
+  {
+    std::size_t rowBytes = m_width * channels();
+    for (std::size_t i = 0; i < m_height; i++)
+      std::copy(image.ptr(i), image.ptr(i) + rowBytes, data(0) + i * stride(0));
+    return;
+  }
+
+  if (image.empty())
+    return;
+
+  // OpenCV converts only even sized images to 4:2:0. Odd sized ones are padded
+  // by repeating their last column and row, which the frame then leaves out.
+  cv::Mat even = image;
+  if (m_width % 2 || m_height % 2)
+  {
+    even = cv::Mat((int)(m_height + m_height % 2), (int)(m_width + m_width % 2), CV_8UC3);
+    for (int i = 0; i < even.rows; i++)
+    {
+      const uint8_t* psrc = image.ptr(std::min(i, image.rows - 1));
+      uint8_t* pdst = even.ptr(i);
+      std::copy(psrc, psrc + m_width * 3, pdst);
+      if (m_width % 2)
+        std::copy(psrc + (m_width - 1) * 3, psrc + m_width * 3, pdst + m_width * 3);
+    }
+  }
+
+  cv::Mat yuv;
+  cv::cvtColor(even, yuv, cv::COLOR_BGR2YUV_I420);
+
+  for (std::size_t i = 0; i < m_height; i++)
+    std::copy(yuv.ptr((int)i), yuv.ptr((int)i) + m_width, data(0) + i * stride(0));
+
+  // OpenCV stores I420 as one contiguous buffer: the Y plane followed by the U and V planes
+  std::size_t chromaWidth = even.cols / 2;
+  const uint8_t* puPlane = yuv.data + even.cols * even.rows;
+  const uint8_t* pvPlane = puPlane + chromaWidth * planeHeight(1);
+  for (std::size_t i = 0; i < planeHeight(1); i++)
+  {
+    const uint8_t* pu = puPlane + i * chromaWidth;
+    const uint8_t* pv = pvPlane + i * chromaWidth;
+
+    if (m_colorFormat == ColorFormat::I420)
+    {
+      std::copy(pu, pu + chromaWidth, data(1) + i * stride(1));
+      std::copy(pv, pv + chromaWidth, data(2) + i * stride(2));
+    }
+    else
+    {
+      uint8_t* puv = data(1) + i * stride(1);
+      for (std::size_t j = 0; j < chromaWidth; j++)
+      {
+        puv[j * 2] = pu[j];
+        puv[j * 2 + 1] = pv[j];
+      }
+    }
+  }
+}
+
+VideoFrame::VideoFrame(std::size_t width, std::size_t height, ColorFormat colorFormat, const std::vector<uint8_t*>& planes, const std::vector<std::size_t>& strides, std::shared_ptr<void> owner):
+  m_width(width),
+  m_height(height),
+  m_strides(strides),
+  m_colorFormat(colorFormat),
+  m_external(planes),
+  m_owner(owner)
+{
+}
+
+VideoFrame::VideoFrame(const VideoFrame& other):
+  m_width(other.m_width),
+  m_height(other.m_height),
+  m_colorFormat(other.m_colorFormat),
+  m_pool(other.m_pool)
+{
+  allocate(false);
+  copyPlanes(other);
+}
+
+VideoFrame::VideoFrame(VideoFrame&& other):
+  m_width(other.m_width),
+  m_height(other.m_height),
+  m_strides(std::move(other.m_strides)),
+  m_data(std::move(other.m_data)),
+  m_colorFormat(other.m_colorFormat),
+  m_pool(std::move(other.m_pool)),
+  m_external(std::move(other.m_external)),
+  m_owner(std::move(other.m_owner))
+{
+  other.m_data.clear();
+  other.m_external.clear();
+}
+
+VideoFrame::~VideoFrame()
+{
+  release();
+}
+
+VideoFrame& VideoFrame::operator=(const VideoFrame& other)
+{
+  if (this == &other)
+    return *this;
+
+  release();
+  m_width = other.m_width;
+  m_height = other.m_height;
+  m_colorFormat = other.m_colorFormat;
+  m_pool = other.m_pool;
+
+  allocate(false);
+  copyPlanes(other);
+
+  return *this;
+}
+
+VideoFrame& VideoFrame::operator=(VideoFrame&& other)
+{
+  if (this == &other)
+    return *this;
+
+  release();
+  m_width = other.m_width;
+  m_height = other.m_height;
+  m_strides = std::move(other.m_strides);
+  m_data = std::move(other.m_data);
+  m_colorFormat = other.m_colorFormat;
+  m_pool = std::move(other.m_pool);
+  m_external = std::move(other.m_external);
+  m_owner = std::move(other.m_owner);
+  other.m_data.clear();
+  other.m_external.clear();
+
+  return *this;
+}
+
+void VideoFrame::allocate(bool clear)
+{
+  std::size_t chromaWidth = (m_width + 1) / 2;
+
+  m_strides.assign(1, alignedStride(m_width * channels()));
+  if (m_colorFormat == ColorFormat::I420)
+  {
+    m_strides.push_back(alignedStride(chromaWidth));
+    m_strides.push_back(alignedStride(chromaWidth));
+  }
+  else if (m_colorFormat == ColorFormat::NV12)
+  {
+    m_strides.push_back(alignedStride(chromaWidth * 2));
+  }
+  m_data.resize(m_strides.size());
+
+  for (std::size_t plane = 0; plane < m_data.size(); plane++)
+  {
+    std::size_t size = m_strides[plane] * planeHeight((int)plane);
+    if (m_pool)
+      m_data[plane] = m_pool->acquire(m_width, m_height, m_colorFormat, (int)plane, size);
+    else
+      m_data[plane].resize(size);
+
+    // chroma planes are cleared to neutral grey
+    if (clear)
+      std::fill(m_data[plane].begin(), m_data[plane].end(), plane == 0 ? 0 : 128);
+  }
+}
+
+void VideoFrame::release()
+{
+  if (m_pool)
+  {
+    for (std::size_t plane = 0; plane < m_data.size(); plane++)
+      m_pool->release(m_width, m_height, m_colorFormat, (int)plane, std::move(m_data[plane]));
+  }
+  m_data.clear();
+  m_external.clear();
+  m_owner.reset();
+}
+
+// external planes may use other strides, so the rows are copied one by one
+void VideoFrame::copyPlanes(const VideoFrame& other)
+{
+  for (std::size_t plane = 0; plane < m_data.size(); plane++)
+  {
+    if (other.m_external.empty() && other.m_strides[plane] == m_strides[plane])
+    {
+      std::copy(other.m_data[plane].begin(), other.m_data[plane].end(), m_data[plane].begin());
+      continue;
+    }
 
-  m_data.resize(1);
-  m_data[0].resize(size);
+    std::size_t rowBytes = std::min(m_strides[plane], other.m_strides[plane]);
+    for (std::size_t i = 0; i < planeHeight((int)plane); i++)
+      std::copy(other.data((int)plane) + i * other.stride((int)plane), other.data((int)plane) + i * other.stride((int)plane) + rowBytes, data((int)plane) + i * stride((int)plane));
+  }
+}
 
-  std::copy(image.data, image.data + size, m_data[0].begin());
+std::size_t VideoFrame::channels() const
+{
+  return m_colorFormat == ColorFormat::Color ? 3 : 1;
+}
+
+bool VideoFrame::isYUV() const
+{
+  return m_colorFormat == ColorFormat::I420 || m_colorFormat == ColorFormat::NV12;
+}
+
+std::size_t VideoFrame::planes() const
+{
+  return m_strides.size();
+}
+
+std::size_t VideoFrame::planeHeight(int plane) const
+{
+  return plane == 0 ? m_height : (m_height + 1) / 2;
 }
 
 void VideoFrame::save(const std::string& fileName)
 {
-  cv::Mat image = cv::Mat((int)m_height, (int)m_width, m_colorFormat == ColorFormat::Color ? CV_8UC3 : CV_8UC1, &(m_data[0][0]));
-  cv::imwrite(fileName, image);
+  if (!isYUV())
+  {
+    cv::Mat image = cv::Mat((int)m_height, (int)m_width, m_colorFormat == ColorFormat::Color ? CV_8UC3 : CV_8UC1, data(0), stride(0));
+    cv::imwrite(fileName, image);
+    return;
+  }
+
+  // OpenCV expects a contiguous buffer with the planes stacked below each other.
+  // Odd sizes are padded to even ones by repeating the last column and row.
+  std::size_t evenWidth = m_width + m_width % 2;
+  std::size_t evenHeight = m_height + m_height % 2;
+  std::size_t chromaWidth = evenWidth / 2;
+  std::size_t chromaHeight = evenHeight / 2;
+  cv::Mat yuv((int)(evenHeight + chromaHeight), (int)evenWidth, CV_8UC1);
+
+  for (std::size_t i = 0; i < evenHeight; i++)
+  {
+    const uint8_t* prow = data(0) + std::min(i, m_height - 1) * stride(0);
+    std::copy(prow, prow + m_width, yuv.ptr((int)i));
+    if (m_width % 2)
+      yuv.ptr((int)i)[m_width] = prow[m_width - 1];
+  }
+
+  uint8_t* pchroma = yuv.data + evenWidth * evenHeight;
+  for (std::size_t i = 0; i < chromaHeight; i++)
+  {
+    if (m_colorFormat == ColorFormat::I420)
+    {
+      std::copy(data(1) + i * stride(1), data(1) + i * stride(1) + chromaWidth, pchroma + i * chromaWidth);
+      std::copy(data(2) + i * stride(2), data(2) + i * stride(2) + chromaWidth, pchroma + (chromaHeight + i) * chromaWidth);
+    }
+    else
+    {
+      std::copy(data(1) + i * stride(1), data(1) + i * stride(1) + chromaWidth * 2, pchroma + i * chromaWidth * 2);
+    }
+  }
+
+  cv::Mat image;
+  cv::cvtColor(yuv, image, m_colorFormat == ColorFormat::I420 ? cv::COLOR_YUV2BGR_I420 : cv::COLOR_YUV2BGR_NV12);
+  cv::imwrite(fileName, cv::Mat((int)m_height, (int)m_width, CV_8UC3, image.data, image.step));
 }
 
 std::size_t VideoFrame::width() const
@@ -56,21 +313,32 @@ std::size_t VideoFrame::height() const
   return m_height;
 }
 
+VideoFrame::ColorFormat VideoFrame::colorFormat() const
+{
+  return m_colorFormat;
+}
+
 std::size_t VideoFrame::stride(int plane) const
 {
-  return m_width;
+  return m_strides[plane];
 }
 
 uint8_t* VideoFrame::data(int plane)
 {
-  return &(m_data[0][plane]);
+  return !m_external.empty() ? m_external[plane] : m_data[plane].data();
+}
+
+const uint8_t* VideoFrame::data(int plane) const
+{
+  return !m_external.empty() ? m_external[plane] : m_data[plane].data();
 }
 
 std::vector<float> VideoFrame::fDCT()
 {
   VideoFrame res(m_width, m_height, m_colorFormat);
   std::vector<float> srcData;
-  srcData.insert(srcData.end(), m_data[0].begin(), m_data[0].end());
+  for (std::size_t i = 0; i < m_height; i++)
+    srcData.insert(srcData.end(), data(0) + i * stride(0), data(0) + i * stride(0) + m_width * channels());
   std::vector<float> dstData(srcData.size());
 
   cv::Mat src = cv::Mat((int)m_height, (int)m_width, CV_32F, &srcData[0]);
@@ -81,76 +349,132 @@ std::vector<float> VideoFrame::fDCT()
   return dstData;
 }
 
-void VideoFrame::DCTSharpening(float threshold, int referenceMax)
+namespace
 {
-  const int blockSize = 8;
-  std::size_t stride = m_width * (m_colorFormat == VideoFrame::Color ? 3 : 1);
-
-  for (int i = 0; i + blockSize <= m_width; i += blockSize)
+  // count blocks, blockStep bytes apart, to and from consecutive float blocks
+  void loadBlocks(const uint8_t* psrc, std::size_t stride, std::size_t blockStep, std::size_t count, float* pblocks)
   {
-    for (int j = 0; j + blockSize <= m_height; j += blockSize)
+    const std::size_t blockSize = DCTKernels::blockSize;
+    for (std::size_t block = 0; block < count; block++, psrc += blockStep, pblocks += DCTKernels::blockFloats)
     {
-      std::vector<float> srcData(blockSize * blockSize);
-      for (int posX = 0; posX < blockSize; posX++)
+      for (std::size_t posY = 0; posY < blockSize; posY++)
       {
-        for (int posY = 0; posY < blockSize; posY++)
-          srcData[posX + posY * blockSize] = m_data[0][i + posX + (j + posY) * stride];
+        for (std::size_t posX = 0; posX < blockSize; posX++)
+          pblocks[posX + posY * blockSize] = psrc[posX + posY * stride];
       }
+    }
+  }
 
-      std::vector<float> dstData(srcData.size());
-      cv::Mat src = cv::Mat((int)blockSize, (int)blockSize, CV_32F, &srcData[0]);
-      cv::Mat dst = cv::Mat((int)blockSize, (int)blockSize, CV_32F, &dstData[0]);
-      cv::dct(src, dst);
-
-      for (int k = 0; k < dstData.size(); k++)
+  void storeBlocks(const float* pblocks, uint8_t* pdst, std::size_t stride, std::size_t blockStep, std::size_t count, int referenceMax)
+  {
+    const std::size_t blockSize = DCTKernels::blockSize;
+    for (std::size_t block = 0; block < count; block++, pdst += blockStep, pblocks += DCTKernels::blockFloats)
+    {
+      for (std::size_t posY = 0; posY < blockSize; posY++)
       {
-        if (dstData[k] < threshold)
+        for (std::size_t posX = 0; posX < blockSize; posX++)
         {
-          if (rand() % 2)
-            dstData[k] = 0;
-          else
-          {
-            int sign = dstData[k] > 0 ? 1 : -1;
-            dstData[k] = threshold * sign;
-          }
+          int val = (int)pblocks[posX + posY * blockSize];
+          if (val < 0)
+            val = 0;
+          else if (val > referenceMax)
+            val = referenceMax;
+
+          pdst[posX + posY * stride] = val;
         }
       }
+    }
+  }
 
-/*      for (int k1 = 0; k1 < blockSize; k1++)
-      {
-        for (int k2 = blockSize - k1 - 1; k2 < blockSize; k2++)
-        {
-          int idx = k1 * blockSize + k2;
-          if (abs(dstData[idx]) < threshold)
-          {
-            if (rand() % 2)
-              dstData[idx] = 0;
-            else
-            {
-              int sign = dstData[idx] > 0 ? 1 : -1;
-              dstData[idx] = threshold * sign;
-            }
-          }
-        }
-      }*/
+  inline void sharpen(float& coefficient, float threshold, bool zero)
+  {
+    if (zero)
+      coefficient = 0;
+    else
+    {
+      int sign = coefficient > 0 ? 1 : -1;
+      coefficient = threshold * sign;
+    }
+  }
+}
+
+void VideoFrame::DCTSharpening(float threshold, int referenceMax, Optimization optimization)
+{
+  const std::size_t blockSize = DCTKernels::blockSize;
+  optimization = resolveOptimization(optimization);
+
+  // A column of blocks is transformed at once, in the order rand() was
+  // always drawn in, with one buffer for the whole frame.
+  std::size_t blocks = m_height / blockSize;
+  std::vector<float> coefficients(blocks * DCTKernels::blockFloats);
+  std::size_t stride = m_strides[0];
 
-      cv::idct(dst, src);
+  for (std::size_t i = 0; i + blockSize <= m_width; i += blockSize)
+  {
+    loadBlocks(data(0) + i, stride, blockSize * stride, blocks, coefficients.data());
+    DCTKernels::forward(coefficients.data(), blocks, optimization);
 
-      for (int posX = 0; posX < blockSize; posX++)
+    for (float& coefficient : coefficients)
+    {
+      if (coefficient < threshold)
+        sharpen(coefficient, threshold, rand() % 2 != 0);
+    }
+
+    DCTKernels::inverse(coefficients.data(), blocks, optimization);
+    storeBlocks(coefficients.data(), data(0) + i, stride, blockSize * stride, blocks, referenceMax);
+  }
+}
+
+void VideoFrame::DCTSharpening(float threshold, int referenceMax, uint64_t seed, Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  DCTSharpening(threshold, referenceMax, seed, threadPool, optimization);
+}
+
+void VideoFrame::DCTSharpening(float threshold, int referenceMax, uint64_t seed, ThreadPool& threadPool, Optimization optimization)
+{
+  const std::size_t blockSize = DCTKernels::blockSize;
+  optimization = resolveOptimization(optimization);
+
+  std::size_t columns = m_width / blockSize;
+  std::size_t rows = m_height / blockSize;
+  std::size_t stride = m_strides[0];
+  if (!columns)
+    return;
+
+  // Block (x, y) draws its 64 decisions from the Philox block with the counter
+  // (x, y, 1, 0), so the result does not depend on how the rows are split. The
+  // reference patterns of GeneratorKernels::generate use (j, row, 0, 0), so a
+  // pattern sharpened with its own key gets decisions independent of its values.
+  std::size_t grain = std::max<std::size_t>(1, 256 / columns);
+  threadPool.parallel_for(0, rows, grain, [&](std::size_t first, std::size_t last)
+  {
+    std::vector<float> coefficients(columns * DCTKernels::blockFloats);
+    for (std::size_t y = first; y < last; y++)
+    {
+      uint8_t* prow = data(0) + y * blockSize * stride;
+      loadBlocks(prow, stride, blockSize, columns, coefficients.data());
+      DCTKernels::forward(coefficients.data(), columns, optimization);
+
+      for (std::size_t x = 0; x < columns; x++)
       {
-        for (int posY = 0; posY < blockSize; posY++)
-        {
-          int val = srcData[posX + posY * blockSize];
-          if (val < 0)
-            val = 0;
-          else if (val > referenceMax)
-            val = referenceMax;
+        uint32_t counter[4] = { (uint32_t)x, (uint32_t)y, 1, 0 };
+        uint32_t words[4];
+        GeneratorKernels::philox(counter, seed, words);
+        uint64_t bits = words[0] | ((uint64_t)words[1] << 32);
 
-          m_data[0][i + posX + (j + posY) * stride] = val;
+        float* pblock = coefficients.data() + x * DCTKernels::blockFloats;
+        for (std::size_t k = 0; k < DCTKernels::blockFloats; k++)
+        {
+          if (pblock[k] < threshold)
+            sharpen(pblock[k], threshold, (bits >> k) & 1);
         }
       }
+
+      DCTKernels::inverse(coefficients.data(), columns, optimization);
+      storeBlocks(coefficients.data(), prow, stride, blockSize, columns, referenceMax);
     }
-  }
+  });
 }
 
 VideoFrame VideoFrame::iDCT(std::vector<float> dctData, std::size_t width, std::size_t height)
@@ -162,147 +486,262 @@ VideoFrame VideoFrame::iDCT(std::vector<float> dctData, std::size_t width, std::
   cv::Mat dst = cv::Mat((int)height, (int)width, CV_32F, &dstData[0]);
 
   cv::idct(src, dst);
-  std::copy(dstData.begin(), dstData.end(), res.m_data[0].begin());
+  for (std::size_t i = 0; i < height; i++)
+    std::copy(dstData.begin() + i * width, dstData.begin() + (i + 1) * width, res.data(0) + i * res.stride(0));
 
   return res;
 }
 
 namespace
 {
-  void applyWRImpl_C(uint8_t* preference, uint8_t* pdata, std::size_t width, std::size_t stride, std::size_t height, double alpha, bool key, bool bypassByRows = true)
+  void applyWRImpl(const uint8_t* preference, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t width, std::size_t height, EmbedKernels::Gain gain, bool key, VideoFrame::Optimization optimization)
+  {
+    EmbedKernels::apply(preference, refStride, pdata, stride, width, height, gain, key, optimization);
+  }
+
+  // 2D partition of a plane into tiles that fit, together with the matching
+  // reference tile, into a typical 256 KB L2 cache
+  struct TileGrid
+  {
+    std::size_t tileWidth;
+    std::size_t tileHeight;
+    std::size_t columns;
+    std::size_t rows;
+  };
+
+  TileGrid makeTileGrid(std::size_t rowBytes, std::size_t height, std::size_t threads)
+  {
+    const std::size_t maxTileWidth = 4096;
+    const std::size_t tileBytes = 64 * 1024;
+
+    TileGrid grid;
+    if (rowBytes == 0 || height == 0)
+    {
+      // an empty plane is one empty tile
+      grid.tileWidth = rowBytes;
+      grid.tileHeight = height;
+      grid.columns = 1;
+      grid.rows = 1;
+      return grid;
+    }
+
+    grid.columns = (rowBytes + maxTileWidth - 1) / maxTileWidth;
+    grid.tileWidth = alignedStride((rowBytes + grid.columns - 1) / grid.columns);
+    grid.columns = (rowBytes + grid.tileWidth - 1) / grid.tileWidth;
+
+    grid.tileHeight = std::max<std::size_t>(1, tileBytes / grid.tileWidth);
+
+    // keep several tiles per thread so the dynamic distribution can balance the load
+    std::size_t minTiles = threads * 4;
+    std::size_t minRows = (minTiles + grid.columns - 1) / grid.columns;
+    grid.tileHeight = std::max<std::size_t>(1, std::min(grid.tileHeight, height / minRows));
+
+    grid.rows = (height + grid.tileHeight - 1) / grid.tileHeight;
+    return grid;
+  }
+
+  void applyWRTasks(const uint8_t* pwr, std::size_t refStride, uint8_t* pdata, std::size_t stride, std::size_t rowBytes, std::size_t height, EmbedKernels::Gain gain, bool key, ThreadPool& threadPool, const VideoFrame::Plan& plan)
   {
-    if (bypassByRows)
+    VideoFrame::Optimization optimization = VideoFrame::resolveOptimization(plan.optimization);
+
+    // padding bytes are never shown, so with identical row layouts whole rows are
+    // processed and the vector kernels need no scalar tail
+    if (refStride == stride && rowBytes <= stride)
+      rowBytes = stride;
+
+    // the calling thread takes part in parallel_for
+    std::size_t threads = std::min(plan.threads, threadPool.size() + 1);
+    if (threads <= 1)
+    {
+      applyWRImpl(pwr, refStride, pdata, stride, rowBytes, height, gain, key, optimization);
+      return;
+    }
+
+    if (plan.threading == VideoFrame::Tiles)
     {
-      for (int i = 0; i < height; i++)
+      TileGrid grid = makeTileGrid(rowBytes, height, threads);
+
+      threadPool.parallel_for(0, grid.columns * grid.rows, 1, [&](std::size_t first, std::size_t last)
       {
-        for (int j = 0; j < width; j++)
+        for (std::size_t tile = first; tile < last; tile++)
         {
-          int val = pdata[i * stride + j];
-          int wr = preference[i * stride + j] * alpha;
-          if (alpha - 1.0 > std::numeric_limits<float>::epsilon())
-            wr = (int)wr * alpha;
-          if (key)
-            val = std::min(255, val + wr);
-          else
-            val = std::max(0, val - wr);
-          pdata[i * stride + j] = val;
+          std::size_t row = tile / grid.columns * grid.tileHeight;
+          std::size_t column = tile % grid.columns * grid.tileWidth;
+          std::size_t tileWidth = std::min(grid.tileWidth, rowBytes - column);
+          std::size_t tileHeight = std::min(grid.tileHeight, height - row);
+
+          applyWRImpl(pwr + row * refStride + column, refStride, pdata + row * stride + column, stride, tileWidth, tileHeight, gain, key, optimization);
         }
-      }
+      });
     }
-    else
+    else if (plan.threading == VideoFrame::Rows || plan.threading == VideoFrame::Adaptive)
     {
-      for (int j = 0; j < width; j++)
+      threadPool.parallel_for(0, height, (height + threads - 1) / threads, [&](std::size_t first, std::size_t last)
       {
-        for (int i = 0; i < height; i++)
-        {
-          int val = pdata[i * stride + j];
-          int wr = preference[i * stride + j] * alpha;
-          if (alpha - 1.0 > std::numeric_limits<float>::epsilon())
-            wr = (int)wr * alpha;
-          if (key)
-            val = std::min(255, val + wr);
-          else
-            val = std::max(0, val - wr);
-          pdata[i * stride + j] = val;
-        }
-      }
+        applyWRImpl(pwr + first * refStride, refStride, pdata + first * stride, stride, rowBytes, last - first, gain, key, optimization);
+      });
     }
-  }
-#ifdef WIN32
-  void applyWRImpl_SSE(uint8_t* preference, uint8_t* pdata, std::size_t stride, std::size_t height, bool key)
-  {
-    for (int i = 0; i < height; i++)
+    else
     {
-      for (int j = 0; j < stride / 16; j++)
+      threadPool.parallel_for(0, rowBytes, (rowBytes + threads - 1) / threads, [&](std::size_t first, std::size_t last)
       {
-        __m128i val = _mm_load_si128((__m128i*)(pdata + (i * stride + j * 16)));
-        __m128i wr = _mm_load_si128((__m128i*)(preference + (i * stride + j * 16)));
-
-        if (key)
-        {
-          val = _mm_adds_epu8(val, wr);
-        }
-        else
-        {
-          val = _mm_subs_epu8(val, wr);
-        }
+        applyWRImpl(pwr + first, refStride, pdata + first, stride, last - first, height, gain, key, optimization);
+      });
+    }
+  }
 
-        _mm_store_si128((__m128i*)(pdata + (i * stride + j * 16)), val);
-      }
+  using ReferenceSegments::segmentBytes;
+  using ReferenceSegments::fillSegment;
 
-      for (int j = ((int)stride / 16) * 16; j < stride; j++)
+  template <typename Reference>
+  void applySegmentRows(const Reference& reference, uint8_t* pdata, std::size_t stride, std::size_t rowBytes, std::size_t first, std::size_t last, EmbedKernels::Gain gain, bool key, VideoFrame::Optimization optimization)
+  {
+    alignas(64) uint8_t tile[segmentBytes];
+    for (std::size_t row = first; row < last; row++)
+    {
+      for (std::size_t column = 0; column < rowBytes; column += segmentBytes)
       {
-        int val = pdata[i * stride + j];
-        int wr = preference[i * stride + j];
-        if (key)
-          val = std::min(255, val + wr);
-        else
-          val = std::max(0, val - wr);
-        pdata[i * stride + j] = val;
+        std::size_t bytes = std::min(segmentBytes, rowBytes - column);
+        fillSegment(reference, tile, row, column, bytes, optimization);
+        applyWRImpl(tile, 0, pdata + row * stride + column, stride, bytes, 1, gain, key, optimization);
       }
     }
   }
 
-  void applyWRImpl_AVX(uint8_t* preference, uint8_t* pdata, std::size_t stride, std::size_t height, bool key)
+  template <typename Reference>
+  bool applySegmentTasks(const Reference& reference, VideoFrame& frame, double alpha, bool key, ThreadPool& threadPool, VideoFrame::Optimization optimization)
   {
-    for (int i = 0; i < height; i++)
-    {
-      for (int j = 0; j < stride / 32; j++)
-      {
-        __m256i val = _mm256_load_si256((__m256i*)(pdata + (i * stride + j * 32)));
-        __m256i wr = _mm256_load_si256((__m256i*)(preference + (i * stride + j * 32)));
-
-        if (key)
-        {
-          val = _mm256_adds_epu8(val, wr);
-        }
-        else
-        {
-          val = _mm256_subs_epu8(val, wr);
-        }
+    if (frame.width() != reference.width() || frame.height() != reference.height() || frame.channels() != reference.channels())
+      return false;
 
-        _mm256_store_si256((__m256i*)(pdata + (i * stride + j * 32)), val);
-      }
+    optimization = VideoFrame::resolveOptimization(optimization);
+    EmbedKernels::Gain gain = EmbedKernels::makeGain(alpha);
+    std::size_t rowBytes = frame.width() * frame.channels();
 
-      for (int j = ((int)stride / 32) * 32; j < stride; j++)
-      {
-        int val = pdata[i * stride + j];
-        int wr = (int)(preference[i * stride + j]);
-        if (key)
-          val = std::min(255, val + wr);
-        else
-          val = std::max(0, val - wr);
-        pdata[i * stride + j] = val;
-      }
-    }
+    // unpacking costs more than reading the frame, so rows are handed out in
+    // small chunks for balance
+    std::size_t grain = std::max<std::size_t>(1, 64 * 1024 / std::max<std::size_t>(1, rowBytes));
+    threadPool.parallel_for(0, frame.height(), grain, [&](std::size_t first, std::size_t last)
+    {
+      applySegmentRows(reference, frame.data(0), frame.stride(0), rowBytes, first, last, gain, key, optimization);
+    });
+    return true;
   }
-#endif
 
-  void applyWRImpl(uint8_t *preference, uint8_t *pdata, std::size_t width, std::size_t stride, std::size_t height, double alpha, bool key, VideoFrame::Optimization optimization, VideoFrame::ThreadingType threading)
+  // Rows go in bands that do not wrap around the tile and each band in
+  // segments that start at tile column 0
+  void applyTiledRows(const TiledReference& reference, uint8_t* pdata, std::size_t stride, std::size_t rowBytes, std::size_t first, std::size_t last, EmbedKernels::Gain gain, bool key, VideoFrame::Optimization optimization)
   {
-    if (optimization == VideoFrame::C || optimization == VideoFrame::Auto)
+    for (std::size_t row = first; row < last; )
     {
-      applyWRImpl_C(preference, pdata, width, stride, height, alpha, key, true/*, threading == VideoFrame::Rows*/);
+      std::size_t rows = std::min(last - row, reference.height() - row % reference.height());
+      for (std::size_t column = 0; column < rowBytes; column += reference.segmentBytes())
+        applyWRImpl(reference.row(row), reference.stride(), pdata + row * stride + column, stride, std::min(reference.segmentBytes(), rowBytes - column), rows, gain, key, optimization);
+      row += rows;
     }
-#ifdef WIN32
-    else if (optimization == VideoFrame::SSE)
+  }
+
+  struct BatchReference
+  {
+    const uint8_t*     data;
+    std::size_t        stride;
+    std::size_t        width;
+    std::size_t        height;
+    std::size_t        channels;
+    EmbedKernels::Gain gain;
+  };
+
+  bool applyWRBatchImpl(std::vector<std::shared_ptr<VideoFrame>>& frames, const BatchReference& reference, const std::vector<bool>& bits, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+  {
+    if (bits.size() != frames.size())
+      return false;
+
+    for (auto& pframe : frames)
     {
-      applyWRImpl_SSE(preference, pdata, stride, height, key);
+      if (!pframe || pframe->width() != reference.width || pframe->height() != reference.height || pframe->channels() != reference.channels)
+        return false;
     }
-    else if (optimization == VideoFrame::AVX)
+
+    if (frames.empty())
+      return true;
+
+    // the batch parallelizes across frames, so only the serial instruction set is tuned
+    ThreadPool serial(0);
+    optimization = VideoFrame::resolvePlan(reference.width, reference.height, frames[0]->colorFormat(), serial, optimization, VideoFrame::Rows).optimization;
+
+    // With enough frames every participant embeds whole frames, which needs no
+    // synchronization inside a frame. Otherwise frames are cut into row slices
+    // (of at least ~128 KB to amortize scheduling) so all cores stay busy.
+    const std::size_t minSliceBytes = 128 * 1024;
+    std::size_t participants = threadPool.size() + 1;
+    std::size_t rowBytes = reference.width * reference.channels;
+    std::size_t height = reference.height;
+
+    std::size_t slices = 1;
+    if (frames.size() < participants * 2)
     {
-      applyWRImpl_AVX(preference, pdata, stride, height, key);
+      slices = (participants * 2 + frames.size() - 1) / frames.size();
+      std::size_t maxSlices = std::max<std::size_t>(1, rowBytes * height / minSliceBytes);
+      slices = std::min(std::min(slices, maxSlices), height);
     }
-#else
-    else
+    std::size_t sliceHeight = (height + slices - 1) / slices;
+    slices = (height + sliceHeight - 1) / sliceHeight;
+
+    threadPool.parallel_for(0, frames.size() * slices, 1, [&](std::size_t first, std::size_t last)
     {
-      applyWRImpl_C(preference, pdata, stride, height, alpha, key, true);
-    }
+      for (std::size_t item = first; item < last; item++)
+      {
+        VideoFrame& frame = *frames[item / slices];
+        std::size_t row = item % slices * sliceHeight;
+        std::size_t rows = std::min(sliceHeight, height - row);
+
+        std::size_t width = rowBytes;
+        if (frame.stride(0) == reference.stride)
+          width = reference.stride;
+
+        applyWRImpl(reference.data + row * reference.stride, reference.stride, frame.data(0) + row * frame.stride(0), frame.stride(0), width, rows, reference.gain, bits[item / slices], optimization);
+      }
+    });
 
-#endif
+    return true;
   }
+}
+
+VideoFrame::Optimization VideoFrame::resolveOptimization(VideoFrame::Optimization optimization)
+{
+  if (optimization == VideoFrame::Auto)
+    optimization = VideoFrame::AVX512;
+
+  if (optimization == VideoFrame::AVX512 && !CpuFeatures::AVX512BW())
+    optimization = VideoFrame::AVX;
+  if (optimization == VideoFrame::AVX && !CpuFeatures::AVX2())
+    optimization = VideoFrame::SSE;
+  if (optimization == VideoFrame::SSE && !CpuFeatures::SSE2())
+    optimization = VideoFrame::C;
+
+  return optimization;
+}
+
+VideoFrame::Plan VideoFrame::resolvePlan(std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat, ThreadPool& threadPool, VideoFrame::Optimization optimization, VideoFrame::ThreadingType threading)
+{
+  VideoFrame::Plan plan = { resolveOptimization(optimization), threading, threadPool.size() + 1 };
 
+  // Auto alone never benchmarks: it takes a tuned or loaded plan when there is
+  // one and the widest instruction set otherwise
+  if (threading != VideoFrame::Adaptive)
+  {
+    VideoFrame::Plan known;
+    if (optimization == VideoFrame::Auto && AutoTuner::instance().findPlan(width, height, colorFormat, threadPool.size(), known))
+      plan.optimization = known.optimization;
+    return plan;
+  }
 
+  VideoFrame::Plan tuned = AutoTuner::instance().plan(width, height, colorFormat, threadPool);
+  if (optimization == VideoFrame::Auto)
+    plan.optimization = tuned.optimization;
+  plan.threading = threadPool.size() == 0 ? VideoFrame::Rows : tuned.threading;
+  plan.threads = threadPool.size() == 0 ? 1 : tuned.threads;
+  return plan;
 }
 
 bool VideoFrame::applyWR(std::shared_ptr<VideoFrame> preference, double alpha, bool key, VideoFrame::Optimization optimization)
@@ -320,64 +759,114 @@ bool VideoFrame::applyWR(std::shared_ptr<VideoFrame> preference, double alpha, b
   if (m_width != preference->width() || m_height != preference->height())
     return false;
 
+  // 4:2:0 frames are watermarked in the luma plane only
+  if ((isYUV() || preference->isYUV()) && channels() != preference->channels())
+    return false;
 
-  uint8_t* pdata = &m_data[0][0];
-  uint8_t* pwr = preference->data(0);
-  std::size_t stride = m_width * (m_colorFormat == VideoFrame::Color ? 3 : 1);
+  return applyWR(preference, alpha, key, threadPool, resolvePlan(m_width, m_height, m_colorFormat, threadPool, optimization, threading));
+}
 
-  if (threadPool.size() == 0)
-  {
-    applyWRImpl(pwr, pdata, stride, stride, m_height, alpha, key, optimization, threading);
-    return true;
-  }
+bool VideoFrame::applyWR(std::shared_ptr<VideoFrame> preference, double alpha, bool key, ThreadPool& threadPool, const VideoFrame::Plan& plan)
+{
+  if (!preference)
+    return false;
 
-  std::size_t threads = threadPool.size();
-  std::vector<std::future<void>> results;
+  if (m_width != preference->width() || m_height != preference->height())
+    return false;
 
-  std::vector<std::size_t> tasksHeight(threads);
-  std::vector<uint8_t *> tasksPData(threads);
-  std::vector<uint8_t*> tasksPwr(threads);
-  std::vector<std::size_t> tasksWidth(threads);
+  if ((isYUV() || preference->isYUV()) && channels() != preference->channels())
+    return false;
 
-  if (threading == VideoFrame::Rows)
-  {
-    std::size_t offset = 0;
-    for (int i = 0; i < threads; i++)
-    {
-      tasksHeight[i] = m_height / threads;
-      tasksPData[i] = pdata + offset;
-      tasksPwr[i] = pwr + offset;
-      tasksWidth[i] = stride;
-      offset += tasksHeight[i] * stride;
-    }
-    tasksHeight[threads - 1] = m_height - m_height / threads * (threads - 1);
-  }
-  else
-  {
-    std::size_t offset = 0;
-    for (int i = 0; i < threads; i++)
-    {
-      tasksHeight[i] = m_height;
-      tasksPData[i] = pdata + offset;
-      tasksPwr[i] = pwr + offset;
-      tasksWidth[i] = stride / threads;
-      offset += stride / threads;
-    }
-    tasksWidth[threads - 1] = stride - stride / threads * (threads - 1);
-  }
+  applyWRTasks(preference->data(0), preference->stride(0), data(0), stride(0), m_width * channels(), m_height, EmbedKernels::makeGain(alpha), key, threadPool, plan);
+  return true;
+}
 
+bool VideoFrame::applyWR(std::shared_ptr<PreparedReference> preference, bool key, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return applyWR(preference, key, threadPool, optimization);
+}
 
+bool VideoFrame::applyWR(std::shared_ptr<PreparedReference> preference, bool key, ThreadPool& threadPool, VideoFrame::Optimization optimization, VideoFrame::ThreadingType threading)
+{
+  if (!preference)
+    return false;
 
-  std::size_t offset = 0;
-  for (int i = 0; i < threads; i++)
-  {
-    results.emplace_back(threadPool.enqueue(applyWRImpl, tasksPwr[i], tasksPData[i], tasksWidth[i], stride, tasksHeight[i], alpha, key, optimization, threading));
-    offset += tasksHeight[i] * stride;
-  }
+  if (m_width != preference->width() || m_height != preference->height() || channels() != preference->channels())
+    return false;
+
+  applyWRTasks(preference->data(), preference->stride(), data(0), stride(0), m_width * channels(), m_height, EmbedKernels::prescaledGain(), key, threadPool, resolvePlan(m_width, m_height, m_colorFormat, threadPool, optimization, threading));
+  return true;
+}
 
-  for (auto&& result : results)
-    result.get();
+bool VideoFrame::applyWR(std::shared_ptr<ProceduralReference> preference, double alpha, bool key, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return applyWR(preference, alpha, key, threadPool, optimization);
+}
 
+bool VideoFrame::applyWR(std::shared_ptr<ProceduralReference> preference, double alpha, bool key, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!preference)
+    return false;
+
+  return applySegmentTasks(*preference, *this, alpha, key, threadPool, optimization);
+}
+
+bool VideoFrame::applyWR(std::shared_ptr<CompactReference> preference, double alpha, bool key, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return applyWR(preference, alpha, key, threadPool, optimization);
+}
+
+bool VideoFrame::applyWR(std::shared_ptr<CompactReference> preference, double alpha, bool key, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!preference)
+    return false;
+
+  return applySegmentTasks(*preference, *this, alpha, key, threadPool, optimization);
+}
+
+bool VideoFrame::applyWR(std::shared_ptr<TiledReference> preference, double alpha, bool key, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return applyWR(preference, alpha, key, threadPool, optimization);
+}
+
+bool VideoFrame::applyWR(std::shared_ptr<TiledReference> preference, double alpha, bool key, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!preference || preference->segmentBytes() == 0)
+    return false;
+
+  if (channels() != preference->channels())
+    return false;
+
+  optimization = resolveOptimization(optimization);
+  EmbedKernels::Gain gain = EmbedKernels::makeGain(alpha);
+  std::size_t rowBytes = m_width * channels();
+
+  std::size_t threads = threadPool.size() + 1;
+  threadPool.parallel_for(0, m_height, (m_height + threads - 1) / threads, [&](std::size_t first, std::size_t last)
+  {
+    applyTiledRows(*preference, data(0), stride(0), rowBytes, first, last, gain, key, optimization);
+  });
   return true;
 }
 
+bool VideoFrame::applyWRBatch(std::vector<std::shared_ptr<VideoFrame>>& frames, std::shared_ptr<VideoFrame> preference, const std::vector<bool>& bits, double alpha, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!preference)
+    return false;
+
+  BatchReference reference = { preference->data(0), preference->stride(0), preference->width(), preference->height(), preference->channels(), EmbedKernels::makeGain(alpha) };
+  return applyWRBatchImpl(frames, reference, bits, threadPool, optimization);
+}
+
+bool VideoFrame::applyWRBatch(std::vector<std::shared_ptr<VideoFrame>>& frames, std::shared_ptr<PreparedReference> preference, const std::vector<bool>& bits, ThreadPool& threadPool, VideoFrame::Optimization optimization)
+{
+  if (!preference)
+    return false;
+
+  BatchReference reference = { preference->data(), preference->stride(), preference->width(), preference->height(), preference->channels(), EmbedKernels::prescaledGain() };
+  return applyWRBatchImpl(frames, reference, bits, threadPool, optimization);
+}
@@ -7,6 +7,13 @@
 #include <memory>
 
 #include "ThreadPool.h"
+#include "AlignedAllocator.h"
+
+class PreparedReference;
+class ProceduralReference;
+class TiledReference;
+class CompactReference;
+class FramePool;
 
 class VideoFrame
 {
@@ -16,45 +23,116 @@ public:
     Auto,
     C, 
     SSE,
-    AVX
+    AVX,
+    AVX512
   };
 
   enum ThreadingType
   {
     Rows,
-    Collumns
+    Collumns,
+    Tiles,    //L2 sized 2D tiles handed out to the workers on demand
+    Adaptive  //partitioning picked by the AutoTuner for the frame geometry and pool
   };
 
   enum ColorFormat
   {
     Color, //bgr
-    Grayscale
+    Grayscale,
+    I420,  //planar Y, U, V with 2x2 subsampled chroma
+    NV12   //planar Y and interleaved UV with 2x2 subsampled chroma
+  };
+
+  // fully specified execution configuration, see AutoTuner
+  struct Plan
+  {
+    Optimization  optimization;
+    ThreadingType threading;
+    std::size_t   threads;  //partitions the frame is split into
   };
 
 
   VideoFrame(std::size_t width = 0, std::size_t height = 0, ColorFormat colorFormat = ColorFormat::Color);
-  VideoFrame(const std::string& fileName, ColorFormat colorFormat = ColorFormat::Color);
+  // planes are borrowed from the pool and not cleared
+  VideoFrame(std::size_t width, std::size_t height, ColorFormat colorFormat, std::shared_ptr<FramePool> pool);
+  VideoFrame(const std::string& fileName, ColorFormat colorFormat = ColorFormat::Color, std::shared_ptr<FramePool> pool = nullptr);
+  // Wraps planes stored elsewhere, for example in a mapped file, without copying
+  // them. owner keeps that memory alive as long as the frame uses it, or is null
+  // when the caller does. Copies of the frame get planes of their own.
+  VideoFrame(std::size_t width, std::size_t height, ColorFormat colorFormat, const std::vector<uint8_t*>& planes, const std::vector<std::size_t>& strides, std::shared_ptr<void> owner);
+  VideoFrame(const VideoFrame& other);
+  VideoFrame(VideoFrame&& other);
+  ~VideoFrame();
+
+  VideoFrame& operator=(const VideoFrame& other);
+  VideoFrame& operator=(VideoFrame&& other);
 
   void save(const std::string& fileName);
 
   bool applyWR(std::shared_ptr<VideoFrame> preference, double alpha, bool key, Optimization optimization = Auto);
   bool applyWR(std::shared_ptr<VideoFrame> preference, double alpha, bool key, ThreadPool &threadPool, Optimization optimization = Auto, ThreadingType threading  = Rows);
+  bool applyWR(std::shared_ptr<VideoFrame> preference, double alpha, bool key, ThreadPool &threadPool, const Plan& plan);
+  bool applyWR(std::shared_ptr<PreparedReference> preference, bool key, Optimization optimization = Auto);
+  bool applyWR(std::shared_ptr<PreparedReference> preference, bool key, ThreadPool &threadPool, Optimization optimization = Auto, ThreadingType threading  = Rows);
+  // the reference is regenerated from its key row segment by row segment, so only the frame is read
+  bool applyWR(std::shared_ptr<ProceduralReference> preference, double alpha, bool key, Optimization optimization = Auto);
+  bool applyWR(std::shared_ptr<ProceduralReference> preference, double alpha, bool key, ThreadPool &threadPool, Optimization optimization = Auto);
+  // the packed reference is unpacked row segment by row segment
+  bool applyWR(std::shared_ptr<CompactReference> preference, double alpha, bool key, Optimization optimization = Auto);
+  bool applyWR(std::shared_ptr<CompactReference> preference, double alpha, bool key, ThreadPool &threadPool, Optimization optimization = Auto);
+  // the tile is repeated over the frame, which may have any size
+  bool applyWR(std::shared_ptr<TiledReference> preference, double alpha, bool key, Optimization optimization = Auto);
+  bool applyWR(std::shared_ptr<TiledReference> preference, double alpha, bool key, ThreadPool &threadPool, Optimization optimization = Auto);
+
+  // Embeds bits[i] into frames[i] using one pool for both frame level and in-frame parallelism.
+  // Nothing is changed if any frame does not match the reference.
+  static bool applyWRBatch(std::vector<std::shared_ptr<VideoFrame>>& frames, std::shared_ptr<VideoFrame> preference, const std::vector<bool>& bits, double alpha, ThreadPool& threadPool, Optimization optimization = Auto);
+  static bool applyWRBatch(std::vector<std::shared_ptr<VideoFrame>>& frames, std::shared_ptr<PreparedReference> preference, const std::vector<bool>& bits, ThreadPool& threadPool, Optimization optimization = Auto);
+
+  // Maps Auto to the widest instruction set supported by the CPU and lowers
+  // unsupported requests to the nearest available one.
+  static Optimization resolveOptimization(Optimization optimization);
+  // Replaces Adaptive with the tuned plan for this geometry and pool, tuning it on
+  // first use. Auto takes the instruction set of a known plan, or the widest one.
+  static Plan resolvePlan(std::size_t width, std::size_t height, ColorFormat colorFormat, ThreadPool& threadPool, Optimization optimization, ThreadingType threading);
 
   std::size_t width() const;
   std::size_t height() const;
+  ColorFormat colorFormat() const;
+  // interleaved channels of plane 0 (the luma plane of 4:2:0 formats)
+  std::size_t channels() const;
+  bool isYUV() const;
+  std::size_t planes() const;
+  std::size_t planeHeight(int plane) const;
+  // row size in bytes, padded so rows start on a 64-byte boundary
   std::size_t stride(int plane) const;
   uint8_t* data(int plane);
+  const uint8_t* data(int plane) const;
 
   std::vector<float> fDCT();
   static VideoFrame iDCT(std::vector<float> dctData, std::size_t width, std::size_t height);
-  void DCTSharpening(float threshold, int referenceMax);
+  // Randomizes the 8x8 block DCT coefficients below threshold to 0 or
+  // +-threshold and clamps the result to [0, referenceMax]. Uses rand().
+  void DCTSharpening(float threshold, int referenceMax, Optimization optimization = Auto);
+  // Same, with the decisions of each block drawn from a generator seeded by
+  // the seed and the block position: the result is the same for every run
+  // and any number of threads.
+  void DCTSharpening(float threshold, int referenceMax, uint64_t seed, Optimization optimization = Auto);
+  void DCTSharpening(float threshold, int referenceMax, uint64_t seed, ThreadPool &threadPool, Optimization optimization = Auto);
 
 private:
+  void allocate(bool clear);
+  void release();
+  void copyPlanes(const VideoFrame& other);
+
   std::size_t                       m_width;
   std::size_t                       m_height;
   std::vector<std::size_t>          m_strides;
-  std::vector<std::vector<uint8_t>> m_data;
+  std::vector<AlignedBuffer>        m_data;
   ColorFormat                       m_colorFormat;
+  std::shared_ptr<FramePool>        m_pool;
+  std::vector<uint8_t*>             m_external;  //planes owned by m_owner instead of m_data
+  std::shared_ptr<void>             m_owner;
 };
 
 
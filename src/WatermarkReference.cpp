@@ -1,20 +1,55 @@
 #include "WatermarkReference.h"
-#include <memory.h>
+#include "GeneratorKernels.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace
+{
+  std::size_t bytesPerPixel(VideoFrame::ColorFormat colorFormat)
+  {
+    return colorFormat == VideoFrame::Color ? 3 : 1;
+  }
+}
 
 std::shared_ptr<VideoFrame> WR::createRandom(std::size_t width, std::size_t height, uint8_t threshold, VideoFrame::ColorFormat colorFormat)
 {
-  auto pframe = std::make_shared<VideoFrame>(width, height, colorFormat);
+  // rand() gives at least 15 bits per call
+  uint64_t key = 0;
+  for (int i = 0; i < 5; i++)
+    key = (key << 15) ^ (uint64_t)rand();
 
-  uint8_t *pdata = pframe->data(0);
-  int bytesPerPixel = colorFormat == VideoFrame::Color ? 3 : 1;
-  memset(pdata, 0, pframe->height() * pframe->stride(0) * bytesPerPixel);
+  return createRandom(width, height, threshold, key, colorFormat);
+}
 
-  std::size_t frameSize = pframe->height() * pframe->stride(0) * bytesPerPixel;
-  for (int i = 0; i < frameSize; i++)
+std::shared_ptr<VideoFrame> WR::createRandom(std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, VideoFrame::ColorFormat colorFormat, VideoFrame::Optimization optimization)
+{
+  ThreadPool threadPool(0);
+  return createRandom(width, height, threshold, key, threadPool, colorFormat, optimization);
+}
+
+std::shared_ptr<VideoFrame> WR::createRandom(std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, ThreadPool& threadPool, VideoFrame::ColorFormat colorFormat, VideoFrame::Optimization optimization)
+{
+  auto pframe = std::make_shared<VideoFrame>(width, height, colorFormat);
+  optimization = VideoFrame::resolveOptimization(optimization);
+
+  // rows are independent parts of the stream, so any split gives the same reference
+  std::size_t rowBytes = width * bytesPerPixel(colorFormat);
+  std::size_t grain = std::max<std::size_t>(1, 64 * 1024 / std::max<std::size_t>(1, rowBytes));
+  threadPool.parallel_for(0, height, grain, [&](std::size_t first, std::size_t last)
   {
-    uint8_t val = rand() % threshold;
-    pdata[i] = val;
-  }
+    for (std::size_t i = first; i < last; i++)
+      GeneratorKernels::generate(pframe->data(0) + i * pframe->stride(0), key, (uint32_t)i, 0, rowBytes, threshold, optimization);
+  });
 
   return pframe;
 }
+
+void WR::generateRegion(uint8_t* pdst, std::size_t stride, std::size_t x, std::size_t y, std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, VideoFrame::ColorFormat colorFormat, VideoFrame::Optimization optimization)
+{
+  optimization = VideoFrame::resolveOptimization(optimization);
+
+  std::size_t channels = bytesPerPixel(colorFormat);
+  for (std::size_t i = 0; i < height; i++)
+    GeneratorKernels::generate(pdst + i * stride, key, (uint32_t)(y + i), x * channels, width * channels, threshold, optimization);
+}
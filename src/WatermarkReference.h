@@ -2,13 +2,25 @@
 #define WATERMARK_REFERENCE_H_
 
 #include "VideoFrame.h"
+#include <cstdint>
 #include <memory>
 
 class VideoFrame;
 
 namespace WR
 {
+  // Draws the key from rand(), so the reference follows srand() as before
   std::shared_ptr<VideoFrame> createRandom(std::size_t width, std::size_t height, uint8_t threshold, VideoFrame::ColorFormat colorFormat = VideoFrame::Color);
+
+  // Reference values in [0, threshold) from the Philox stream of key (see
+  // GeneratorKernels). The same key always gives the same reference, for every
+  // instruction set and pool size.
+  std::shared_ptr<VideoFrame> createRandom(std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, VideoFrame::ColorFormat colorFormat = VideoFrame::Color, VideoFrame::Optimization optimization = VideoFrame::Auto);
+  std::shared_ptr<VideoFrame> createRandom(std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, ThreadPool& threadPool, VideoFrame::ColorFormat colorFormat = VideoFrame::Color, VideoFrame::Optimization optimization = VideoFrame::Auto);
+
+  // Writes the pixels [x, x + width) x [y, y + height) of plane 0 of the keyed
+  // reference, bit-exactly equal to that area of createRandom with the same key
+  void generateRegion(uint8_t* pdst, std::size_t stride, std::size_t x, std::size_t y, std::size_t width, std::size_t height, uint8_t threshold, uint64_t key, VideoFrame::ColorFormat colorFormat = VideoFrame::Color, VideoFrame::Optimization optimization = VideoFrame::Auto);
 }
 
 #endif
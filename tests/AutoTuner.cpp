@@ -0,0 +1,135 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "AutoTuner.h"
+
+BOOST_AUTO_TEST_SUITE(auto_tuner);
+
+BOOST_AUTO_TEST_CASE(plan_is_tuned_once)
+{
+  int width = 352, height = 288;
+  AutoTuner tuner;
+  ThreadPool threadPool(3);
+
+  BOOST_CHECK(!tuner.hasPlan(width, height, VideoFrame::Grayscale, threadPool.size()));
+  VideoFrame::Plan plan = tuner.plan(width, height, VideoFrame::Grayscale, threadPool);
+  BOOST_CHECK(tuner.hasPlan(width, height, VideoFrame::Grayscale, threadPool.size()));
+
+  BOOST_CHECK(plan.optimization != VideoFrame::Auto);
+  BOOST_CHECK_EQUAL(VideoFrame::resolveOptimization(plan.optimization), plan.optimization);
+  BOOST_CHECK(plan.threading != VideoFrame::Adaptive);
+  BOOST_CHECK(plan.threads >= 1 && plan.threads <= threadPool.size() + 1);
+
+  VideoFrame::Plan cached = tuner.plan(width, height, VideoFrame::Grayscale, threadPool);
+  BOOST_CHECK_EQUAL(cached.optimization, plan.optimization);
+  BOOST_CHECK_EQUAL(cached.threading, plan.threading);
+  BOOST_CHECK_EQUAL(cached.threads, plan.threads);
+
+  // a serial pool tunes only the instruction set
+  ThreadPool serial(0);
+  VideoFrame::Plan serialPlan = tuner.plan(width, height, VideoFrame::Grayscale, serial);
+  BOOST_CHECK_EQUAL(serialPlan.threading, VideoFrame::Rows);
+  BOOST_CHECK_EQUAL(serialPlan.threads, 1);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_matches_c)
+{
+  // the global tuner is left as it was found
+  AutoTuner::instance().clear();
+  int width = 200, height = 120;
+  auto preference = WR::createRandom(width, height, 10);
+  ThreadPool threadPool(4);
+
+  VideoFrame frame(width, height);
+  uint8_t* pdata = frame.data(0);
+  for (int i = 0; i < height; i++)
+    for (int j = 0; j < width * 3; j++)
+      pdata[i * frame.stride(0) + j] = (uint8_t)(i * 3 + j);
+
+  VideoFrame frameC = frame;
+  frameC.applyWR(preference, 1.5, true, VideoFrame::C);
+
+  // whatever the tuner picks, the result is bit exact
+  frame.applyWR(preference, 1.5, true, threadPool, VideoFrame::Auto, VideoFrame::Adaptive);
+  std::size_t size = frame.stride(0) * height;
+  BOOST_CHECK_EQUAL_COLLECTIONS(frameC.data(0), frameC.data(0) + size, frame.data(0), frame.data(0) + size);
+  BOOST_CHECK(AutoTuner::instance().hasPlan(width, height, VideoFrame::Color, threadPool.size()));
+  AutoTuner::instance().clear();
+}
+
+BOOST_AUTO_TEST_CASE(auto_does_not_tune)
+{
+  AutoTuner::instance().clear();
+  int width = 210, height = 130;
+  auto preference = WR::createRandom(width, height, 10);
+  ThreadPool threadPool(2);
+
+  VideoFrame frame(width, height);
+  BOOST_CHECK(frame.applyWR(preference, 1.0, true));
+  BOOST_CHECK(frame.applyWR(preference, 1.0, true, threadPool));
+  BOOST_CHECK(!AutoTuner::instance().hasPlan(width, height, VideoFrame::Color, 0));
+  BOOST_CHECK(!AutoTuner::instance().hasPlan(width, height, VideoFrame::Color, threadPool.size()));
+
+  // a known plan is used without measuring
+  VideoFrame::Plan plan = { VideoFrame::C, VideoFrame::Rows, 1 };
+  AutoTuner::instance().setPlan(width, height, VideoFrame::Color, 0, plan);
+  ThreadPool serial(0);
+  BOOST_CHECK_EQUAL(VideoFrame::resolvePlan(width, height, VideoFrame::Color, serial, VideoFrame::Auto, VideoFrame::Rows).optimization, VideoFrame::C);
+  BOOST_CHECK_EQUAL(VideoFrame::resolvePlan(width, height, VideoFrame::Color, serial, VideoFrame::SSE, VideoFrame::Rows).optimization, VideoFrame::resolveOptimization(VideoFrame::SSE));
+  AutoTuner::instance().clear();
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_tuning)
+{
+  AutoTuner tuner;
+  ThreadPool threadPool(2);
+
+  // each geometry is measured once, every request gets its plan
+  std::vector<VideoFrame::Plan> plans(8);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < plans.size(); i++)
+    threads.emplace_back([&, i]() { plans[i] = tuner.plan(160 + (i % 2) * 160, 120, VideoFrame::Color, threadPool); });
+  for (auto& thread : threads)
+    thread.join();
+
+  for (std::size_t i = 2; i < plans.size(); i++)
+  {
+    BOOST_CHECK_EQUAL(plans[i].optimization, plans[i % 2].optimization);
+    BOOST_CHECK_EQUAL(plans[i].threading, plans[i % 2].threading);
+    BOOST_CHECK_EQUAL(plans[i].threads, plans[i % 2].threads);
+  }
+  BOOST_CHECK(tuner.hasPlan(160, 120, VideoFrame::Color, threadPool.size()));
+  BOOST_CHECK(tuner.hasPlan(320, 120, VideoFrame::Color, threadPool.size()));
+}
+
+BOOST_AUTO_TEST_CASE(save_load_profile)
+{
+  AutoTuner tuner;
+  VideoFrame::Plan plan = { VideoFrame::C, VideoFrame::Tiles, 3 };
+  tuner.setPlan(1920, 1080, VideoFrame::NV12, 7, plan);
+
+  std::string fileName = getSourceDir(__FILE__) + "out/auto_tuner_profile.txt";
+  BOOST_CHECK(tuner.save(fileName));
+
+  tuner.clear();
+  BOOST_CHECK(!tuner.hasPlan(1920, 1080, VideoFrame::NV12, 7));
+  BOOST_CHECK(tuner.load(fileName));
+  BOOST_CHECK(tuner.hasPlan(1920, 1080, VideoFrame::NV12, 7));
+
+  ThreadPool threadPool(7);
+  VideoFrame::Plan loaded = tuner.plan(1920, 1080, VideoFrame::NV12, threadPool);
+  BOOST_CHECK_EQUAL(loaded.optimization, VideoFrame::C);
+  BOOST_CHECK_EQUAL(loaded.threading, VideoFrame::Tiles);
+  BOOST_CHECK_EQUAL(loaded.threads, 3);
+  std::remove(fileName.c_str());
+
+  BOOST_CHECK(!tuner.load(getSourceDir(__FILE__) + "out/missing_profile.txt"));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,104 @@
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "CompactReference.h"
+#include "CompactKernels.h"
+#include "Detector.h"
+
+BOOST_AUTO_TEST_SUITE(compact_reference);
+
+BOOST_AUTO_TEST_CASE(unpack_optimizations)
+{
+  const std::size_t count = 1000;
+  std::vector<uint8_t> values(count);
+  for (std::size_t i = 0; i < count; i++)
+    values[i] = (uint8_t)(i * 37 % 64);
+
+  std::vector<uint8_t> packed6(count / 4 * 3 + 8);
+  std::vector<uint8_t> signs(count / 8 + 8);
+  CompactKernels::pack6(values.data(), packed6.data(), count);
+  CompactKernels::packSigns(values.data(), signs.data(), count, 31);
+
+  for (auto optimization : { VideoFrame::C, VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+  {
+    // odd counts exercise the scalar tails
+    for (std::size_t length : { count, count - 13 })
+    {
+      std::vector<uint8_t> unpacked(length);
+      CompactKernels::unpack6(packed6.data(), unpacked.data(), length, VideoFrame::resolveOptimization(optimization));
+      BOOST_CHECK(std::equal(unpacked.begin(), unpacked.end(), values.begin()));
+
+      CompactKernels::unpackSigns(signs.data(), unpacked.data(), length, 200, VideoFrame::resolveOptimization(optimization));
+      bool match = true;
+      for (std::size_t i = 0; i < length; i++)
+        match = match && unpacked[i] == (values[i] > 31 ? 200 : 0);
+      BOOST_CHECK(match);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(packed6_matches_reference)
+{
+  auto pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg");
+  auto preference = WR::createRandom(pframe->width(), pframe->height(), 50, 3);
+  auto pcompact = std::make_shared<CompactReference>(preference, CompactReference::Packed6);
+
+  BOOST_CHECK(pcompact->stride() * 4 <= preference->stride(0) * 3 + 4 * 64);
+  BOOST_CHECK(equalPlanes(*preference, *pcompact->materialize()));
+
+  VideoFrame expected(*pframe);
+  expected.applyWR(preference, 0.1, true, VideoFrame::C);
+
+  ThreadPool threadPool(3);
+  for (auto optimization : { VideoFrame::C, VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+  {
+    auto pmarked = std::make_shared<VideoFrame>(*pframe);
+    BOOST_REQUIRE(pmarked->applyWR(pcompact, 0.1, true, threadPool, optimization));
+    BOOST_CHECK(equalPlanes(expected, *pmarked));
+  }
+
+  // exact moments, so the decision equals the one with the full reference
+  Detector::Moments moments;
+  auto pmarked = std::make_shared<VideoFrame>(expected);
+  BOOST_REQUIRE(Detector::computeMoments(pmarked, preference, moments));
+  double corr = Detector::correlation(moments);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pmarked, pcompact, corr * 0.999999), Detector::TRUE);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pmarked, pcompact, corr * 1.000001, threadPool), Detector::NO_WATERMARK);
+}
+
+BOOST_AUTO_TEST_CASE(sign_detection)
+{
+  for (auto colorFormat : { VideoFrame::Color, VideoFrame::I420 })
+  {
+    auto pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg", colorFormat);
+    auto preference = WR::createRandom(pframe->width(), pframe->height(), 50, 5, colorFormat == VideoFrame::Color ? VideoFrame::Color : VideoFrame::Grayscale);
+    auto pcompact = std::make_shared<CompactReference>(preference, CompactReference::Sign);
+
+    // uniform values below 50 have a standard deviation of about 14.4
+    BOOST_CHECK(pcompact->amplitude() >= 28 && pcompact->amplitude() <= 30);
+    BOOST_CHECK(pcompact->stride() * 8 <= preference->stride(0) + 8 * 64);
+
+    auto pframeTrue = std::make_shared<VideoFrame>(*pframe);
+    auto pframeFalse = std::make_shared<VideoFrame>(*pframe);
+    BOOST_REQUIRE(pframeTrue->applyWR(pcompact, 0.1, true));
+    BOOST_REQUIRE(pframeFalse->applyWR(pcompact, 0.1, false));
+
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, pcompact, 0.01), Detector::TRUE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeFalse, pcompact, 0.01), Detector::FALSE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframe, pcompact, 0.01), Detector::NO_WATERMARK);
+
+    // the sign pattern still detects with the full reference
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, 0.01), Detector::TRUE);
+  }
+
+  auto pcompact = std::make_shared<CompactReference>(WR::createRandom(64, 48, 50, 5), CompactReference::Sign);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(std::make_shared<VideoFrame>(64, 40), pcompact, 0.01), Detector::FAILED);
+  BOOST_CHECK(!std::make_shared<VideoFrame>(64, 48, VideoFrame::Grayscale)->applyWR(pcompact, 0.1, true));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -1,5 +1,8 @@
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 #include "Utils.h"
 #include "VideoFrame.h"
 #include "WatermarkReference.h"
@@ -39,4 +42,265 @@ BOOST_AUTO_TEST_CASE(linear_correlation)
   BOOST_CHECK_EQUAL(resNoWatermark, Detector::NO_WATERMARK);
 }
 
+BOOST_AUTO_TEST_CASE(linear_correlation_luma)
+{
+  for (auto colorFormat : { VideoFrame::I420, VideoFrame::NV12 })
+  {
+    std::shared_ptr<VideoFrame> pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg", colorFormat);
+    std::shared_ptr<VideoFrame> pframeTrue = std::make_shared<VideoFrame>(*pframe);
+    std::shared_ptr<VideoFrame> pframeFalse = std::make_shared<VideoFrame>(*pframe);
+
+    auto preference = WR::createRandom(pframe->width(), pframe->height(), 50, VideoFrame::Grayscale);
+
+    pframeTrue->applyWR(preference, 0.1, true);
+    pframeFalse->applyWR(preference, 0.1, false);
+
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, 0.01), Detector::TRUE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeFalse, preference, 0.01), Detector::FALSE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframe, preference, 0.01), Detector::NO_WATERMARK);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(moments_optimizations)
+{
+  // odd widths exercise the row tails, 1080p runs past the 32-bit flush interval
+  struct Size { int width; int height; VideoFrame::ColorFormat colorFormat; };
+  for (Size size : { Size{ 211, 37, VideoFrame::Color }, Size{ 211, 37, VideoFrame::Grayscale }, Size{ 1920, 1080, VideoFrame::Color }, Size{ 1920, 1080, VideoFrame::Grayscale } })
+  {
+    auto pframe = std::make_shared<VideoFrame>(size.width, size.height, size.colorFormat);
+    auto pnoise = std::make_shared<VideoFrame>(size.width, size.height, size.colorFormat);
+    std::size_t rowBytes = size.width * pframe->channels();
+    for (int i = 0; i < size.height; i++)
+    {
+      for (std::size_t j = 0; j < rowBytes; j++)
+      {
+        pframe->data(0)[i * pframe->stride(0) + j] = rand() % 256;
+        pnoise->data(0)[i * pnoise->stride(0) + j] = (uint8_t)(j % 7 * 40 + rand() % 16);
+      }
+    }
+
+    // straightforward two pass reference
+    std::size_t channels = pframe->channels();
+    double expected = 0;
+    for (std::size_t channel = 0; channel < channels; channel++)
+    {
+      double meanF = 0, meanN = 0;
+      for (int i = 0; i < size.height; i++)
+      {
+        for (std::size_t j = channel; j < rowBytes; j += channels)
+        {
+          meanF += pframe->data(0)[i * pframe->stride(0) + j];
+          meanN += pnoise->data(0)[i * pnoise->stride(0) + j];
+        }
+      }
+      meanF /= size.width * size.height;
+      meanN /= size.width * size.height;
+
+      double num = 0, sqrF = 0, sqrN = 0;
+      for (int i = 0; i < size.height; i++)
+      {
+        for (std::size_t j = channel; j < rowBytes; j += channels)
+        {
+          double f = pframe->data(0)[i * pframe->stride(0) + j] - meanF;
+          double n = pnoise->data(0)[i * pnoise->stride(0) + j] - meanN;
+          num += f * n;
+          sqrF += f * f;
+          sqrN += n * n;
+        }
+      }
+      expected += num / std::sqrt(sqrF) / std::sqrt(sqrN);
+    }
+    expected /= channels;
+
+    Detector::Moments momentsC;
+    BOOST_REQUIRE(Detector::computeMoments(pframe, pnoise, momentsC, VideoFrame::C));
+    BOOST_CHECK_EQUAL(momentsC.count, size.width * size.height);
+    BOOST_CHECK_CLOSE(Detector::correlation(momentsC), expected, 1e-6);
+
+    for (auto optimization : { VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+    {
+      Detector::Moments moments;
+      BOOST_REQUIRE(Detector::computeMoments(pframe, pnoise, moments, optimization));
+      BOOST_CHECK_EQUAL(moments.count, momentsC.count);
+      BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumF, moments.sumF + 3, momentsC.sumF, momentsC.sumF + 3);
+      BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumN, moments.sumN + 3, momentsC.sumN, momentsC.sumN + 3);
+      BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumFF, moments.sumFF + 3, momentsC.sumFF, momentsC.sumFF + 3);
+      BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumNN, moments.sumNN + 3, momentsC.sumNN, momentsC.sumNN + 3);
+      BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumFN, moments.sumFN + 3, momentsC.sumFN, momentsC.sumFN + 3);
+    }
+  }
+
+  auto pcolor = std::make_shared<VideoFrame>(64, 64, VideoFrame::Color);
+  auto pgray = std::make_shared<VideoFrame>(64, 64, VideoFrame::Grayscale);
+  Detector::Moments moments;
+  BOOST_CHECK(!Detector::computeMoments(pcolor, pgray, moments));
+}
+
+BOOST_AUTO_TEST_CASE(moments_multithread)
+{
+  int width = 1280, height = 720;
+  auto pframe = std::make_shared<VideoFrame>(width, height);
+  for (int i = 0; i < height; i++)
+    for (int j = 0; j < width * 3; j++)
+      pframe->data(0)[i * pframe->stride(0) + j] = rand() % 256;
+
+  auto preference = WR::createRandom(width, height, 50);
+  pframe->applyWR(preference, 0.5, true);
+
+  Detector::Moments expected;
+  BOOST_REQUIRE(Detector::computeMoments(pframe, preference, expected));
+
+  for (std::size_t threads : { 1, 2, 3, 7 })
+  {
+    ThreadPool threadPool(threads);
+    Detector::Moments moments;
+    BOOST_REQUIRE(Detector::computeMoments(pframe, preference, moments, threadPool));
+    BOOST_CHECK_EQUAL(moments.count, expected.count);
+    BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumF, moments.sumF + 3, expected.sumF, expected.sumF + 3);
+    BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumFF, moments.sumFF + 3, expected.sumFF, expected.sumFF + 3);
+    BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumFN, moments.sumFN + 3, expected.sumFN, expected.sumFN + 3);
+    BOOST_CHECK_EQUAL_COLLECTIONS(moments.sumNN, moments.sumNN + 3, expected.sumNN, expected.sumNN + 3);
+    BOOST_CHECK_EQUAL(Detector::correlation(moments), Detector::correlation(expected));
+
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframe, preference, 0.01, threadPool), Detector::TRUE);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(linear_correlations)
+{
+  int width = 333, height = 250;
+  std::vector<std::shared_ptr<VideoFrame>> references;
+  for (int i = 0; i < 12; i++)
+    references.push_back(WR::createRandom(width, height, 50));
+
+  auto pframe = std::make_shared<VideoFrame>(width, height);
+  for (int i = 0; i < height; i++)
+    for (int j = 0; j < width * 3; j++)
+      pframe->data(0)[i * pframe->stride(0) + j] = (uint8_t)(i + j * 7);
+  pframe->applyWR(references[5], 0.5, true);
+
+  ThreadPool threadPool(3);
+  std::vector<double> correlations = Detector::LinearCorrelations(pframe, references);
+  std::vector<double> correlationsMT = Detector::LinearCorrelations(pframe, references, threadPool);
+  BOOST_REQUIRE_EQUAL(correlations.size(), references.size());
+  BOOST_CHECK_EQUAL_COLLECTIONS(correlations.begin(), correlations.end(), correlationsMT.begin(), correlationsMT.end());
+
+  for (std::size_t i = 0; i < references.size(); i++)
+  {
+    Detector::Moments moments;
+    Detector::computeMoments(pframe, references[i], moments);
+    BOOST_CHECK_EQUAL(correlations[i], Detector::correlation(moments));
+  }
+  BOOST_CHECK_EQUAL(std::max_element(correlations.begin(), correlations.end()) - correlations.begin(), 5);
+
+  std::vector<std::shared_ptr<VideoFrame>> grayReferences = { WR::createRandom(width, height, 50, VideoFrame::Grayscale), WR::createRandom(width, height, 50, VideoFrame::Grayscale) };
+  auto pgray = std::make_shared<VideoFrame>(width, height, VideoFrame::Grayscale);
+  for (int i = 0; i < height; i++)
+    for (int j = 0; j < width; j++)
+      pgray->data(0)[i * pgray->stride(0) + j] = (uint8_t)(i * 3 + j);
+  pgray->applyWR(grayReferences[1], 0.5, false);
+
+  std::vector<double> grayCorrelations = Detector::LinearCorrelations(pgray, grayReferences);
+  BOOST_REQUIRE_EQUAL(grayCorrelations.size(), 2);
+  for (std::size_t i = 0; i < grayReferences.size(); i++)
+  {
+    Detector::Moments moments;
+    Detector::computeMoments(pgray, grayReferences[i], moments, VideoFrame::C);
+    BOOST_CHECK_EQUAL(grayCorrelations[i], Detector::correlation(moments));
+  }
+  BOOST_CHECK(grayCorrelations[1] < 0);
+
+  references.push_back(std::make_shared<VideoFrame>(width, height / 2));
+  BOOST_CHECK(Detector::LinearCorrelations(pframe, references).empty());
+}
+
+BOOST_AUTO_TEST_CASE(progressive_linear_correlation)
+{
+  int width = 1920, height = 1080;
+  auto pframe = std::make_shared<VideoFrame>(width, height, VideoFrame::Grayscale);
+  for (int i = 0; i < height; i++)
+    for (int j = 0; j < width; j++)
+      pframe->data(0)[i * pframe->stride(0) + j] = (uint8_t)(128 + 80 * std::sin(i * 0.01) * std::cos(j * 0.013));
+
+  auto preference = WR::createRandom(width, height, 50, VideoFrame::Grayscale);
+  auto pframeTrue = std::make_shared<VideoFrame>(*pframe);
+  auto pframeFalse = std::make_shared<VideoFrame>(*pframe);
+  pframeTrue->applyWR(preference, 0.5, true);
+  pframeFalse->applyWR(preference, 0.5, false);
+
+  std::size_t pixels = width * height;
+  Detector::Moments moments;
+  BOOST_CHECK_EQUAL(Detector::ProgressiveLinearCorrelation(pframeTrue, preference, 0.01, 3.29, &moments), Detector::TRUE);
+  BOOST_CHECK(moments.count < pixels / 10);
+  BOOST_CHECK_EQUAL(Detector::ProgressiveLinearCorrelation(pframeFalse, preference, 0.01, 3.29, &moments), Detector::FALSE);
+  BOOST_CHECK(moments.count < pixels / 10);
+  BOOST_CHECK_EQUAL(Detector::ProgressiveLinearCorrelation(pframe, preference, 0.01, 3.29, &moments), Detector::NO_WATERMARK);
+  BOOST_CHECK(moments.count < pixels);
+
+  // an interval that can never be narrow enough falls back to the whole frame
+  BOOST_CHECK_EQUAL(Detector::ProgressiveLinearCorrelation(pframeTrue, preference, 0.01, 1e6, &moments), Detector::LinearCorrelation(pframeTrue, preference, 0.01));
+  BOOST_CHECK_EQUAL(moments.count, pixels);
+
+  BOOST_CHECK_EQUAL(Detector::ProgressiveLinearCorrelation(pframe, std::make_shared<VideoFrame>(width, height), 0.01), Detector::FAILED);
+}
+
+BOOST_AUTO_TEST_CASE(progressive_linear_correlation_unmarked)
+{
+  // repeated looks must not turn the noise of an unmarked frame into a detection
+  int width = 640, height = 360;
+  auto pframe = randomFrame(width, height, 256, 1, VideoFrame::Grayscale);
+  for (unsigned seed = 2; seed < 34; seed++)
+  {
+    auto preference = randomFrame(width, height, 50, seed, VideoFrame::Grayscale);
+    Detector::Moments moments;
+    Detector::Result result = Detector::ProgressiveLinearCorrelation(pframe, preference, 0.01, 3.29, &moments);
+    BOOST_CHECK_EQUAL(result, Detector::LinearCorrelation(pframe, preference, 0.01));
+    BOOST_CHECK(moments.count >= 1024);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(cross_correlation)
+{
+  std::shared_ptr<VideoFrame> pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg");
+  std::shared_ptr<VideoFrame> pframeTrue = std::make_shared<VideoFrame>(*pframe);
+  std::shared_ptr<VideoFrame> pframeFalse = std::make_shared<VideoFrame>(*pframe);
+
+  auto preference = WR::createRandom(pframe->width(), pframe->height(), 50);
+  pframeTrue->applyWR(preference, 0.1, true);
+  pframeFalse->applyWR(preference, 0.1, false);
+
+  const std::size_t left = 37;
+  const std::size_t top = 101;
+  const std::size_t width = 320;
+  const std::size_t height = 240;
+  auto crop = [&](std::shared_ptr<VideoFrame> psource)
+  {
+    auto pcrop = std::make_shared<VideoFrame>(width, height);
+    for (std::size_t y = 0; y < height; y++)
+      std::copy_n(psource->data(0) + (top + y) * psource->stride(0) + left * 3, width * 3, pcrop->data(0) + y * pcrop->stride(0));
+    return pcrop;
+  };
+
+  Detector::Peak peak = {};
+  BOOST_CHECK_EQUAL(Detector::CrossCorrelation(crop(pframeTrue), preference, 0.02, &peak), Detector::TRUE);
+  BOOST_CHECK_EQUAL(peak.dx, (int)left);
+  BOOST_CHECK_EQUAL(peak.dy, (int)top);
+
+  BOOST_CHECK_EQUAL(Detector::CrossCorrelation(crop(pframeFalse), preference, 0.02, &peak), Detector::FALSE);
+  BOOST_CHECK_EQUAL(peak.dx, (int)left);
+  BOOST_CHECK_EQUAL(peak.dy, (int)top);
+
+  BOOST_CHECK_EQUAL(Detector::CrossCorrelation(crop(pframe), preference, 0.02, &peak), Detector::NO_WATERMARK);
+
+  // aligned frames peak at the origin with the plain linear correlation
+  Detector::Moments moments;
+  BOOST_REQUIRE(Detector::computeMoments(pframeTrue, preference, moments));
+  BOOST_CHECK_EQUAL(Detector::CrossCorrelation(pframeTrue, preference, 0.02, &peak), Detector::TRUE);
+  BOOST_CHECK_EQUAL(peak.dx, 0);
+  BOOST_CHECK_EQUAL(peak.dy, 0);
+  BOOST_CHECK_CLOSE(peak.correlation, Detector::correlation(moments), 1e-9);
+
+  BOOST_CHECK_EQUAL(Detector::CrossCorrelation(pframe, std::make_shared<VideoFrame>(width, height, VideoFrame::Grayscale), 0.02), Detector::FAILED);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
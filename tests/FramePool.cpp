@@ -0,0 +1,63 @@
+#include <boost/test/unit_test.hpp>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "FramePool.h"
+
+BOOST_AUTO_TEST_SUITE(frame_pool);
+
+BOOST_AUTO_TEST_CASE(steady_state_without_allocations)
+{
+  int width = 320, height = 240;
+  auto pool = std::make_shared<FramePool>();
+  auto preference = WR::createRandom(width, height, 10);
+
+  for (int i = 0; i < 10; i++)
+  {
+    std::vector<std::shared_ptr<VideoFrame>> pframes;
+    for (int j = 0; j < 4; j++)
+      pframes.push_back(std::make_shared<VideoFrame>(width, height, VideoFrame::Color, pool));
+
+    for (auto& pframe : pframes)
+      pframe->applyWR(preference, 1.0, true);
+  }
+
+  BOOST_CHECK_EQUAL(pool->allocations(), 4);
+  BOOST_CHECK_EQUAL(pool->freeBuffers(), 4);
+
+  VideoFrame grayscale(width, height, VideoFrame::Grayscale, pool);
+  BOOST_CHECK_EQUAL(pool->allocations(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(copy_borrows_from_pool)
+{
+  int width = 100, height = 50;
+  auto pool = std::make_shared<FramePool>();
+
+  auto psource = WR::createRandom(width, height, 0xFF);
+  VideoFrame frame(width, height, VideoFrame::Color, pool);
+  frame = *psource;
+
+  std::size_t size = frame.stride(0) * height;
+  BOOST_CHECK_EQUAL_COLLECTIONS(psource->data(0), psource->data(0) + size, frame.data(0), frame.data(0) + size);
+
+  {
+    VideoFrame pooled(width, height, VideoFrame::Color, pool);
+    std::copy(psource->data(0), psource->data(0) + size, pooled.data(0));
+
+    VideoFrame copy = pooled;
+    BOOST_CHECK_EQUAL_COLLECTIONS(pooled.data(0), pooled.data(0) + size, copy.data(0), copy.data(0) + size);
+
+    VideoFrame moved = std::move(copy);
+    BOOST_CHECK_EQUAL_COLLECTIONS(pooled.data(0), pooled.data(0) + size, moved.data(0), moved.data(0) + size);
+  }
+
+  BOOST_CHECK_EQUAL(pool->freeBuffers(), 2);
+
+  VideoFrame reused(width, height, VideoFrame::Color, pool);
+  BOOST_CHECK_EQUAL(pool->freeBuffers(), 1);
+  BOOST_CHECK_EQUAL(pool->allocations(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
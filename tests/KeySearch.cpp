@@ -0,0 +1,93 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "Detector.h"
+#include "KeySearch.h"
+
+BOOST_AUTO_TEST_SUITE(key_search);
+
+namespace
+{
+  std::shared_ptr<VideoFrame> makeFrame(int width, int height, int seed)
+  {
+    auto pframe = std::make_shared<VideoFrame>(width, height);
+    for (int i = 0; i < height; i++)
+      for (int j = 0; j < width * 3; j++)
+        pframe->data(0)[i * pframe->stride(0) + j] = (uint8_t)(128 + 60 * std::sin((i + seed) * 0.05) + 40 * std::cos(j * 0.02 * (seed + 1)));
+    return pframe;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(correlations_match_detector)
+{
+  int width = 160, height = 120;
+  std::vector<std::shared_ptr<VideoFrame>> references;
+  for (int i = 0; i < 40; i++)
+    references.push_back(WR::createRandom(width, height, 50));
+
+  KeySearch search(references);
+  BOOST_CHECK_EQUAL(search.size(), references.size());
+
+  auto pframe = makeFrame(width, height, 1);
+  pframe->applyWR(references[23], 0.5, false);
+
+  std::vector<double> correlations = search.correlations(pframe);
+  BOOST_REQUIRE_EQUAL(correlations.size(), references.size());
+  for (std::size_t i = 0; i < references.size(); i++)
+  {
+    Detector::Moments moments;
+    Detector::computeMoments(pframe, references[i], moments);
+    BOOST_CHECK_CLOSE(correlations[i], Detector::correlation(moments), 1e-9);
+  }
+
+  ThreadPool threadPool(3);
+  std::vector<double> correlationsMT = search.correlations(pframe, threadPool);
+  BOOST_CHECK_EQUAL_COLLECTIONS(correlations.begin(), correlations.end(), correlationsMT.begin(), correlationsMT.end());
+
+  // a batch gives the same vectors as single frames
+  std::vector<std::shared_ptr<VideoFrame>> frames = { makeFrame(width, height, 2), pframe, makeFrame(width, height, 3) };
+  std::vector<std::vector<double>> batch = search.correlations(frames, threadPool);
+  BOOST_REQUIRE_EQUAL(batch.size(), frames.size());
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    std::vector<double> single = search.correlations(frames[i]);
+    BOOST_CHECK_EQUAL_COLLECTIONS(batch[i].begin(), batch[i].end(), single.begin(), single.end());
+  }
+
+  BOOST_CHECK(search.correlations(std::make_shared<VideoFrame>(width, height, VideoFrame::Grayscale)).empty());
+}
+
+BOOST_AUTO_TEST_CASE(search_top_candidates)
+{
+  int width = 256, height = 192;
+  std::vector<std::shared_ptr<VideoFrame>> references;
+  for (int i = 0; i < 64; i++)
+    references.push_back(WR::createRandom(width, height, 50));
+
+  auto pframe = makeFrame(width, height, 4);
+  pframe->applyWR(references[41], 1.0, true);
+
+  KeySearch exact(references);
+  KeySearch coarse(references, 4);
+  ThreadPool threadPool(2);
+
+  std::vector<KeySearch::Match> matches = exact.search(pframe, 3, threadPool);
+  BOOST_REQUIRE_EQUAL(matches.size(), 3);
+  BOOST_CHECK_EQUAL(matches[0].index, 41);
+  BOOST_CHECK(matches[0].correlation > 0);
+  BOOST_CHECK(std::fabs(matches[0].correlation) >= std::fabs(matches[1].correlation));
+
+  std::vector<KeySearch::Match> refined = coarse.search(pframe, 1);
+  BOOST_REQUIRE_EQUAL(refined.size(), 1);
+  BOOST_CHECK_EQUAL(refined[0].index, 41);
+  BOOST_CHECK_EQUAL(refined[0].correlation, matches[0].correlation);
+
+  references.push_back(std::make_shared<VideoFrame>(width, height / 2));
+  BOOST_CHECK_EQUAL(KeySearch(references).size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -3,6 +3,7 @@
 #include "Utils.h"
 #include "VideoFrame.h"
 #include "WatermarkReference.h"
+#include "FramePool.h"
 
 #include <csv2.hpp>
 
@@ -59,9 +60,10 @@ void performanceTest(std::string testName, std::vector<std::string> names, int f
     for (int i = 1; i <= processorCount; i += 1)
     {
       ThreadPool threadPool(streamsCnt);
+      auto pool = std::make_shared<FramePool>(framesInTest);
       std::vector<std::shared_ptr<VideoFrame>> pframes(framesInTest);
       for (std::size_t k = 0; k < names.size(); k++)
-        pframes[k] = std::make_shared<VideoFrame>(names[k]);
+        pframes[k] = std::make_shared<VideoFrame>(names[k], VideoFrame::Color, pool);
       for(std::size_t k = names.size(); k<framesInTest; k++)
         pframes[k] = std::make_shared<VideoFrame>(*pframes[k % names.size()]);
 
@@ -130,9 +132,10 @@ BOOST_AUTO_TEST_CASE(performance, * boost::unit_test::disabled())
 
 std::size_t performanceOptimizationTest(std::string testName, std::vector<std::string> names, int framesInTest, int testsCount, VideoFrame::Optimization optimization)
 {
+  auto pool = std::make_shared<FramePool>(framesInTest);
   std::vector<std::shared_ptr<VideoFrame>> pframes(names.size());
   for (std::size_t k = 0; k < names.size(); k++)
-    pframes[k] = std::make_shared<VideoFrame>(names[k]);
+    pframes[k] = std::make_shared<VideoFrame>(names[k], VideoFrame::Color, pool);
 
   std::size_t fullDuration = 0;
 
@@ -221,9 +224,10 @@ void performanceHorizontalAndVertical(std::string testName, std::vector<std::str
     if (i == 1)
       continue;
 
+    auto pool = std::make_shared<FramePool>(framesInTest);
     std::vector<std::shared_ptr<VideoFrame>> pframes(framesInTest);
     for (std::size_t k = 0; k < names.size(); k++)
-      pframes[k] = std::make_shared<VideoFrame>(names[k]);
+      pframes[k] = std::make_shared<VideoFrame>(names[k], VideoFrame::Color, pool);
     for (std::size_t k = names.size(); k < framesInTest; k++)
       pframes[k] = std::make_shared<VideoFrame>(*pframes[k % names.size()]);
     std::vector<std::future<size_t>> results;
@@ -266,14 +270,67 @@ BOOST_AUTO_TEST_CASE(performanceThreadingType, *boost::unit_test::disabled())
 
   performanceHorizontalAndVertical("SD-vertical", namesHD, 1000, 100, VideoFrame::Collumns);
   performanceHorizontalAndVertical("SD-horizontal", namesHD, 1000, 100, VideoFrame::Rows);
+  performanceHorizontalAndVertical("SD-tiles", namesHD, 1000, 100, VideoFrame::Tiles);
 
 
   performanceHorizontalAndVertical("HD-vertical", namesHD, 500, 50, VideoFrame::Collumns);
   performanceHorizontalAndVertical("HD-horizontal", namesHD, 500, 50,VideoFrame::Rows);
+  performanceHorizontalAndVertical("HD-tiles", namesHD, 500, 50, VideoFrame::Tiles);
 
   performanceHorizontalAndVertical("4K-vertical", namesHD, 200, 25, VideoFrame::Collumns);
   performanceHorizontalAndVertical("4K-horizontal", namesHD, 200, 25, VideoFrame::Rows);
+  performanceHorizontalAndVertical("4K-tiles", namesHD, 200, 25, VideoFrame::Tiles);
 }
 
 
+void performanceBatchTest(std::string testName, std::vector<std::string> names, int framesInTest, int testsCount)
+{
+  std::size_t processorCount = std::thread::hardware_concurrency();
+  auto pool = std::make_shared<FramePool>(framesInTest);
+  std::vector<std::shared_ptr<VideoFrame>> pframes(framesInTest);
+  for (std::size_t k = 0; k < names.size() && k < framesInTest; k++)
+    pframes[k] = std::make_shared<VideoFrame>(names[k], VideoFrame::Color, pool);
+  for (std::size_t k = names.size(); k < framesInTest; k++)
+    pframes[k] = std::make_shared<VideoFrame>(*pframes[k % names.size()]);
+
+  uint8_t threahold = 50;
+  auto preference = WR::createRandom(pframes[0]->width(), pframes[0]->height(), threahold);
+
+  for (std::size_t threads = 1; threads <= processorCount; threads++)
+  {
+    ThreadPool threadPool(threads - 1);
+    std::size_t fullDuration = 0;
+    for (int i = 0; i < testsCount; i++)
+    {
+      std::vector<bool> bits(pframes.size());
+      for (int j = 0; j < pframes.size(); j++)
+        bits[j] = rand() % 2;
+
+      auto start = std::chrono::high_resolution_clock::now();
+
+      VideoFrame::applyWRBatch(pframes, preference, bits, 0.1, threadPool);
+
+      auto stop = std::chrono::high_resolution_clock::now();
+      fullDuration += std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+    }
+
+    float frameDuration = (float)fullDuration / 1000 / framesInTest / testsCount;
+    std::cout << testName << " batch " << threads << " thread test duration : " << frameDuration << " msec per frame" << std::endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(performanceBatch, *boost::unit_test::disabled())
+{
+  std::vector<std::string> namesHD = { getSourceDir(__FILE__) + "images/agriculture-hd.jpg",
+    getSourceDir(__FILE__) + "images/blue-hd.jpg",
+    getSourceDir(__FILE__) + "images/crane-hd.jpg",
+    getSourceDir(__FILE__) + "images/field-hd.jpg",
+    getSourceDir(__FILE__) + "images/twilight-hd.jpg",
+  };
+
+  performanceBatchTest("HD-1", namesHD, 1, 100);
+  performanceBatchTest("HD-8", namesHD, 8, 50);
+  performanceBatchTest("HD-500", namesHD, 500, 10);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,123 @@
+#include <boost/test/unit_test.hpp>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "PreparedReference.h"
+#include "Detector.h"
+
+BOOST_AUTO_TEST_SUITE(prepared_reference);
+
+BOOST_AUTO_TEST_CASE(layout_and_statistics)
+{
+  int width = 101, height = 20;
+  auto preference = WR::createRandom(width, height, 50);
+  PreparedReference prepared(preference, 0.5);
+
+  BOOST_CHECK_EQUAL(prepared.width(), width);
+  BOOST_CHECK_EQUAL(prepared.height(), height);
+  BOOST_CHECK_EQUAL(prepared.channels(), 3);
+  BOOST_CHECK_EQUAL(prepared.stride() % 64, 0);
+  BOOST_CHECK(prepared.stride() >= (std::size_t)width * 3);
+  BOOST_CHECK_EQUAL((uintptr_t)prepared.data() % 64, 0);
+
+  uint64_t sum[3] = {}, sumOfSquares[3] = {};
+  for (int i = 0; i < height; i++)
+  {
+    for (int j = 0; j < width * 3; j++)
+    {
+      uint8_t val = prepared.data()[i * prepared.stride() + j];
+      BOOST_CHECK(val <= 25);
+      sum[j % 3] += val;
+      sumOfSquares[j % 3] += val * val;
+    }
+  }
+
+  for (int channel = 0; channel < 3; channel++)
+  {
+    BOOST_CHECK_EQUAL(prepared.sum(channel), sum[channel]);
+    BOOST_CHECK_EQUAL(prepared.sumOfSquares(channel), sumOfSquares[channel]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(apply_prepared)
+{
+  int width = 333, height = 41;
+  auto pframe = WR::createRandom(width, height, 0xFF);
+  auto preference = WR::createRandom(width, height, 50);
+  std::size_t size = pframe->stride(0) * height;
+
+  for (double alpha : { 0.1, 1.0, 2.0 })
+  {
+    auto prepared = std::make_shared<PreparedReference>(preference, alpha);
+
+    VideoFrame expected = *pframe;
+    expected.applyWR(preference, alpha, true, VideoFrame::C);
+
+    VideoFrame frame = *pframe;
+    frame.applyWR(prepared, true);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.data(0), expected.data(0) + size, frame.data(0), frame.data(0) + size);
+
+    ThreadPool threadPool(4);
+    VideoFrame frameMT = *pframe;
+    frameMT.applyWR(prepared, true, threadPool, VideoFrame::SSE, VideoFrame::Collumns);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.data(0), expected.data(0) + size, frameMT.data(0), frameMT.data(0) + size);
+  }
+
+  auto grayscale = std::make_shared<PreparedReference>(WR::createRandom(width, height, 50, VideoFrame::Grayscale));
+  BOOST_CHECK(!pframe->applyWR(grayscale, true));
+}
+
+BOOST_AUTO_TEST_CASE(linear_correlation_prepared)
+{
+  std::shared_ptr<VideoFrame> pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg");
+  std::shared_ptr<VideoFrame> pframeTrue = std::make_shared<VideoFrame>(*pframe);
+  std::shared_ptr<VideoFrame> pframeFalse = std::make_shared<VideoFrame>(*pframe);
+
+  auto preference = WR::createRandom(pframe->width(), pframe->height(), 50);
+  auto embedding = std::make_shared<PreparedReference>(preference, 0.1);
+  auto detection = std::make_shared<PreparedReference>(preference);
+
+  pframeTrue->applyWR(embedding, true);
+  pframeFalse->applyWR(embedding, false);
+
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, detection, 0.01), Detector::TRUE);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeFalse, detection, 0.01), Detector::FALSE);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframe, detection, 0.01), Detector::NO_WATERMARK);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, detection, 0.01), Detector::LinearCorrelation(pframeTrue, preference, 0.01));
+}
+
+BOOST_AUTO_TEST_CASE(moments_prepared)
+{
+  ThreadPool threadPool(3);
+  for (auto colorFormat : { VideoFrame::Color, VideoFrame::Grayscale })
+  {
+    auto pframe = WR::createRandom(1001, 600, 0xFF, colorFormat);
+    auto preference = WR::createRandom(1001, 600, 50, colorFormat);
+    auto prepared = std::make_shared<PreparedReference>(preference);
+
+    for (auto optimization : { VideoFrame::C, VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+    {
+      Detector::Moments expected, moments, momentsMT;
+      BOOST_REQUIRE(Detector::computeMoments(pframe, preference, expected, optimization));
+      BOOST_REQUIRE(Detector::computeMoments(pframe, prepared, moments, optimization));
+      BOOST_REQUIRE(Detector::computeMoments(pframe, prepared, momentsMT, threadPool, optimization));
+
+      for (const Detector::Moments& actual : { moments, momentsMT })
+      {
+        BOOST_CHECK_EQUAL(actual.channels, expected.channels);
+        BOOST_CHECK_EQUAL(actual.count, expected.count);
+        BOOST_CHECK_EQUAL_COLLECTIONS(actual.sumF, actual.sumF + 3, expected.sumF, expected.sumF + 3);
+        BOOST_CHECK_EQUAL_COLLECTIONS(actual.sumN, actual.sumN + 3, expected.sumN, expected.sumN + 3);
+        BOOST_CHECK_EQUAL_COLLECTIONS(actual.sumFF, actual.sumFF + 3, expected.sumFF, expected.sumFF + 3);
+        BOOST_CHECK_EQUAL_COLLECTIONS(actual.sumNN, actual.sumNN + 3, expected.sumNN, expected.sumNN + 3);
+        BOOST_CHECK_EQUAL_COLLECTIONS(actual.sumFN, actual.sumFN + 3, expected.sumFN, expected.sumFN + 3);
+      }
+    }
+  }
+
+  Detector::Moments moments;
+  BOOST_CHECK(!Detector::computeMoments(WR::createRandom(64, 64, 0xFF), std::make_shared<PreparedReference>(WR::createRandom(64, 32, 50)), moments));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
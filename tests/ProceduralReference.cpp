@@ -0,0 +1,71 @@
+#include <boost/test/unit_test.hpp>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "ProceduralReference.h"
+#include "Detector.h"
+
+BOOST_AUTO_TEST_SUITE(procedural_reference);
+
+BOOST_AUTO_TEST_CASE(embed_matches_materialized)
+{
+  auto pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg");
+  auto preference = std::make_shared<ProceduralReference>(pframe->width(), pframe->height(), 50, 0x5eedull);
+  auto pmaterialized = preference->materialize();
+
+  BOOST_CHECK(equalPlanes(*pmaterialized, *WR::createRandom(pframe->width(), pframe->height(), 50, 0x5eedull)));
+
+  VideoFrame expected(*pframe);
+  expected.applyWR(pmaterialized, 0.1, true, VideoFrame::C);
+
+  ThreadPool threadPool(3);
+  for (auto optimization : { VideoFrame::C, VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+  {
+    auto pmarked = std::make_shared<VideoFrame>(*pframe);
+    BOOST_REQUIRE(pmarked->applyWR(preference, 0.1, true, optimization));
+    BOOST_CHECK(equalPlanes(expected, *pmarked));
+
+    pmarked = std::make_shared<VideoFrame>(*pframe);
+    BOOST_REQUIRE(pmarked->applyWR(preference, 0.1, true, threadPool, optimization));
+    BOOST_CHECK(equalPlanes(expected, *pmarked));
+  }
+
+  auto pgray = std::make_shared<ProceduralReference>(pframe->width(), pframe->height(), 50, 0x5eedull, VideoFrame::Grayscale);
+  BOOST_CHECK(!pframe->applyWR(pgray, 0.1, true));
+}
+
+BOOST_AUTO_TEST_CASE(detect_without_reference_plane)
+{
+  for (auto colorFormat : { VideoFrame::Color, VideoFrame::I420 })
+  {
+    auto pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg", colorFormat);
+    auto pframeTrue = std::make_shared<VideoFrame>(*pframe);
+    auto pframeFalse = std::make_shared<VideoFrame>(*pframe);
+
+    auto referenceFormat = colorFormat == VideoFrame::Color ? VideoFrame::Color : VideoFrame::Grayscale;
+    auto preference = std::make_shared<ProceduralReference>(pframe->width(), pframe->height(), 50, 42, referenceFormat);
+    pframeTrue->applyWR(preference, 0.1, true);
+    pframeFalse->applyWR(preference, 0.1, false);
+
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, 0.01), Detector::TRUE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeFalse, preference, 0.01), Detector::FALSE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframe, preference, 0.01), Detector::NO_WATERMARK);
+
+    // the moments are exact, so the procedural and the stored reference agree
+    Detector::Moments moments;
+    BOOST_REQUIRE(Detector::computeMoments(pframeTrue, preference->materialize(), moments));
+    ThreadPool threadPool(2);
+    double threshold = Detector::correlation(moments);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, threshold * 0.999999, threadPool), Detector::TRUE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, threshold * 1.000001, threadPool), Detector::NO_WATERMARK);
+
+    auto pother = std::make_shared<ProceduralReference>(pframe->width(), pframe->height(), 50, 43, referenceFormat);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, pother, 0.01), Detector::NO_WATERMARK);
+  }
+
+  auto pframe = std::make_shared<VideoFrame>(64, 48);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframe, std::make_shared<ProceduralReference>(64, 40, 50, 1), 0.01), Detector::FAILED);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
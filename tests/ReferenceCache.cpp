@@ -0,0 +1,195 @@
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "PreparedReference.h"
+#include "ReferenceCache.h"
+
+BOOST_AUTO_TEST_SUITE(reference_cache);
+
+BOOST_AUTO_TEST_CASE(hits_and_eviction)
+{
+  std::atomic<int> generated(0);
+  ReferenceCache::Generator random = ReferenceCache::random(50);
+  auto generator = [&](uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat)
+  {
+    generated++;
+    return random(key, width, height, colorFormat);
+  };
+
+  // room for two 640x480 color references
+  std::size_t frameBytes = alignedStride(640 * 3) * 480;
+  ReferenceCache cache(frameBytes * 2, generator);
+
+  auto pfirst = cache.reference(1, 640, 480, VideoFrame::Color);
+  BOOST_REQUIRE(pfirst);
+  auto pexpected = WR::createRandom(640, 480, 50, 1);
+  BOOST_CHECK_EQUAL_COLLECTIONS(pfirst->data(0), pfirst->data(0) + frameBytes, pexpected->data(0), pexpected->data(0) + frameBytes);
+
+  BOOST_CHECK_EQUAL(cache.reference(1, 640, 480, VideoFrame::Color), pfirst);
+  BOOST_CHECK_EQUAL(generated, 1);
+  BOOST_CHECK_EQUAL(cache.hits(), 1);
+  BOOST_CHECK_EQUAL(cache.misses(), 1);
+
+  // other keys, sizes and formats are separate entries
+  auto psecond = cache.reference(2, 640, 480, VideoFrame::Color);
+  BOOST_CHECK(psecond != pfirst);
+  BOOST_CHECK(cache.reference(1, 320, 240, VideoFrame::Grayscale));
+  BOOST_CHECK_EQUAL(generated, 3);
+  BOOST_CHECK_LE(cache.bytes(), cache.budget());
+
+  // key 1 was used least recently and made room for the grayscale reference
+  BOOST_CHECK_EQUAL(cache.reference(2, 640, 480, VideoFrame::Color), psecond);
+  BOOST_CHECK_EQUAL(generated, 3);
+  BOOST_CHECK(cache.reference(1, 640, 480, VideoFrame::Color) != pfirst);
+  BOOST_CHECK_EQUAL(generated, 4);
+
+  // too large to keep
+  BOOST_CHECK(cache.reference(3, 1280, 720, VideoFrame::Color));
+  BOOST_CHECK(cache.reference(3, 1280, 720, VideoFrame::Color));
+  BOOST_CHECK_EQUAL(generated, 6);
+
+  cache.clear();
+  BOOST_CHECK_EQUAL(cache.entries(), 0);
+  BOOST_CHECK_EQUAL(cache.bytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(prepared)
+{
+  ReferenceCache cache(16 * 1024 * 1024, ReferenceCache::random(50));
+
+  auto pprepared = cache.prepared(5, 640, 480, VideoFrame::Color, 0.5);
+  BOOST_REQUIRE(pprepared);
+  BOOST_CHECK_EQUAL(pprepared->alpha(), 0.5);
+  BOOST_CHECK_EQUAL(cache.misses(), 1);
+  BOOST_CHECK_EQUAL(cache.prepared(5, 640, 480, VideoFrame::Color, 0.5), pprepared);
+  BOOST_CHECK_EQUAL(cache.hits(), 1);
+  BOOST_CHECK_EQUAL(cache.misses(), 1);
+  BOOST_CHECK(cache.prepared(5, 640, 480, VideoFrame::Color, 1.0) != pprepared);
+
+  auto pframe = WR::createRandom(640, 480, 255, 9);
+  VideoFrame expected(*pframe);
+  expected.applyWR(cache.reference(5, 640, 480, VideoFrame::Color), 0.5, true);
+  BOOST_REQUIRE(pframe->applyWR(pprepared, true));
+  std::size_t size = pframe->stride(0) * pframe->height();
+  BOOST_CHECK_EQUAL_COLLECTIONS(pframe->data(0), pframe->data(0) + size, expected.data(0), expected.data(0) + size);
+}
+
+BOOST_AUTO_TEST_CASE(rescaled)
+{
+  auto psource = WR::createRandom(64, 48, 50, 3, VideoFrame::NV12);
+  ReferenceCache cache(16 * 1024 * 1024, ReferenceCache::rescaled({ { 3, psource } }));
+
+  BOOST_CHECK_EQUAL(cache.reference(3, 64, 48, VideoFrame::NV12), psource);
+  BOOST_CHECK(!cache.reference(4, 64, 48, VideoFrame::NV12));
+  BOOST_CHECK(!cache.reference(3, 64, 48, VideoFrame::Color));
+
+  auto pscaled = cache.reference(3, 128, 96, VideoFrame::NV12);
+  BOOST_REQUIRE(pscaled);
+  BOOST_CHECK_EQUAL(pscaled->width(), 128);
+  BOOST_CHECK_EQUAL(pscaled->data(0)[5 * pscaled->stride(0) + 7], psource->data(0)[2 * psource->stride(0) + 3]);
+  BOOST_CHECK_EQUAL(pscaled->data(1)[5 * pscaled->stride(1) + 7 * 2 + 1], psource->data(1)[2 * psource->stride(1) + 3 * 2 + 1]);
+
+  auto pframe = WR::createRandom(128, 96, 255, 9, VideoFrame::NV12);
+  BOOST_CHECK(pframe->applyWR(pscaled, 1.0, true));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent)
+{
+  std::atomic<int> generated(0);
+  ReferenceCache::Generator random = ReferenceCache::random(50);
+  auto generator = [&](uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat)
+  {
+    generated++;
+    // slow enough for the other threads to miss the same entries meanwhile
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return random(key, width, height, colorFormat);
+  };
+
+  ReferenceCache cache(64 * 1024 * 1024, generator);
+  ThreadPool threadPool(4);
+
+  std::vector<std::shared_ptr<VideoFrame>> references(64);
+  threadPool.parallel_for(0, references.size(), 1, [&](std::size_t first, std::size_t last)
+  {
+    for (std::size_t i = first; i < last; i++)
+      references[i] = cache.reference(i % 4, 320 + (i % 2) * 320, 240, VideoFrame::Grayscale);
+  });
+
+  // each entry is generated once, the other calls wait for it
+  BOOST_CHECK_EQUAL(cache.entries(), 4);
+  BOOST_CHECK_EQUAL(generated, 4);
+  BOOST_CHECK_EQUAL(cache.misses(), 4);
+  BOOST_CHECK_EQUAL(cache.hits(), references.size() - 4);
+  for (std::size_t i = 4; i < references.size(); i++)
+    BOOST_CHECK_EQUAL(references[i], references[i % 4]);
+
+  std::vector<std::shared_ptr<PreparedReference>> prepared(16);
+  threadPool.parallel_for(0, prepared.size(), 1, [&](std::size_t first, std::size_t last)
+  {
+    for (std::size_t i = first; i < last; i++)
+      prepared[i] = cache.prepared(7, 320, 240, VideoFrame::Grayscale);
+  });
+
+  BOOST_CHECK_EQUAL(generated, 5);
+  BOOST_CHECK_EQUAL(cache.misses(), 5);
+  for (std::size_t i = 1; i < prepared.size(); i++)
+    BOOST_CHECK_EQUAL(prepared[i], prepared[0]);
+}
+
+BOOST_AUTO_TEST_CASE(throwing_generator)
+{
+  std::atomic<bool> failing(true);
+  std::atomic<int> generated(0);
+  ReferenceCache::Generator random = ReferenceCache::random(50);
+  auto generator = [&](uint64_t key, std::size_t width, std::size_t height, VideoFrame::ColorFormat colorFormat)
+  {
+    generated++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    if (failing)
+      throw std::runtime_error("generator failed");
+    return random(key, width, height, colorFormat);
+  };
+
+  ReferenceCache cache(64 * 1024 * 1024, generator);
+
+  // the calls waiting for the failed generation get its exception
+  std::atomic<int> thrown(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++)
+  {
+    threads.emplace_back([&]()
+    {
+      try
+      {
+        cache.reference(1, 320, 240, VideoFrame::Grayscale);
+      }
+      catch (const std::runtime_error&)
+      {
+        thrown++;
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  BOOST_CHECK_EQUAL(thrown, 4);
+  BOOST_CHECK_EQUAL(cache.entries(), 0);
+  BOOST_CHECK_THROW(cache.prepared(1, 320, 240, VideoFrame::Grayscale), std::runtime_error);
+
+  // failed entries are generated again
+  failing = false;
+  int before = generated;
+  BOOST_CHECK(cache.reference(1, 320, 240, VideoFrame::Grayscale));
+  BOOST_CHECK(cache.prepared(1, 320, 240, VideoFrame::Grayscale));
+  BOOST_CHECK_EQUAL(generated, before + 1);
+  BOOST_CHECK_EQUAL(cache.entries(), 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
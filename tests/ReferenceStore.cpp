@@ -0,0 +1,136 @@
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "ReferenceStore.h"
+#include "Detector.h"
+
+BOOST_AUTO_TEST_SUITE(reference_store);
+
+BOOST_AUTO_TEST_CASE(write_open)
+{
+  auto pcolor = WR::createRandom(640, 480, 50, 11);
+  auto pgray = WR::createRandom(320, 240, 50, 11, VideoFrame::Grayscale);
+  auto pother = WR::createRandom(640, 480, 50, 12);
+  auto pyuv = std::make_shared<VideoFrame>(66, 38, VideoFrame::I420);
+  for (std::size_t plane = 0; plane < pyuv->planes(); plane++)
+    std::fill(pyuv->data((int)plane), pyuv->data((int)plane) + pyuv->stride((int)plane) * pyuv->planeHeight((int)plane), (uint8_t)(plane * 40 + 7));
+
+  std::string fileName = "reference_store.wrs";
+  BOOST_REQUIRE(ReferenceStore::write(fileName, { { 11, pcolor }, { 11, pgray }, { 12, pother }, { 13, pyuv } }));
+
+  ReferenceStore store;
+  BOOST_REQUIRE(store.open(fileName));
+  BOOST_REQUIRE_EQUAL(store.size(), 4);
+  BOOST_CHECK_EQUAL(store.info(1).key, 11);
+  BOOST_CHECK_EQUAL(store.info(1).width, 320);
+  BOOST_CHECK_EQUAL(store.info(1).height, 240);
+  BOOST_CHECK_EQUAL(store.info(1).colorFormat, VideoFrame::Grayscale);
+
+  BOOST_CHECK(equalPlanes(*store.frame(0), *pcolor));
+  BOOST_CHECK(equalPlanes(*store.find(11, 320, 240), *pgray));
+  BOOST_CHECK(equalPlanes(*store.find(12), *pother));
+  BOOST_CHECK(equalPlanes(*store.find(13), *pyuv));
+  BOOST_CHECK(!store.find(11, 1920, 1080));
+  BOOST_CHECK(!store.find(14));
+
+  // planes are used in place
+  auto pmapped = store.find(11);
+  BOOST_CHECK_EQUAL((std::size_t)pmapped->data(0) % 64, 0);
+  BOOST_CHECK_EQUAL(pmapped->stride(0), pcolor->stride(0));
+
+  // the mapped reference embeds and detects like the one it was written from
+  auto pframe = WR::createRandom(640, 480, 255, 5);
+  auto pexpected = std::make_shared<VideoFrame>(*pframe);
+  pexpected->applyWR(pcolor, 0.5, true);
+  auto pmarked = std::make_shared<VideoFrame>(*pframe);
+  BOOST_REQUIRE(pmarked->applyWR(pmapped, 0.5, true));
+  BOOST_CHECK(equalPlanes(*pexpected, *pmarked));
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pmarked, pmapped, 0.01), Detector::LinearCorrelation(pexpected, pcolor, 0.01));
+
+  // frames keep the mapping alive and writes stay private
+  store.close();
+  BOOST_CHECK_EQUAL(store.size(), 0);
+  VideoFrame copy(*pmapped);
+  BOOST_CHECK(equalPlanes(copy, *pcolor));
+  std::fill(pmapped->data(0), pmapped->data(0) + pmapped->stride(0), 0);
+  copy = *pmapped;
+  BOOST_CHECK(!equalPlanes(copy, *pcolor));
+
+  BOOST_REQUIRE(store.open(fileName));
+  BOOST_CHECK(equalPlanes(*store.find(11), *pcolor));
+
+  pmapped.reset();
+  store.close();
+  std::remove(fileName.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(merge)
+{
+  std::string fileName = "reference_store_merge.wrs";
+  std::remove(fileName.c_str());
+
+  auto pfirst = WR::createRandom(64, 48, 50, 1, VideoFrame::Grayscale);
+  auto psecond = WR::createRandom(64, 48, 50, 2, VideoFrame::Grayscale);
+  auto plarge = WR::createRandom(128, 96, 50, 1, VideoFrame::Grayscale);
+  auto preplaced = WR::createRandom(64, 48, 50, 3, VideoFrame::Grayscale);
+
+  BOOST_REQUIRE(ReferenceStore::merge(fileName, { { 1, pfirst } }));
+  BOOST_REQUIRE(ReferenceStore::merge(fileName, { { 2, psecond }, { 1, plarge } }));
+
+  ReferenceStore store;
+  BOOST_REQUIRE(store.open(fileName));
+  BOOST_CHECK_EQUAL(store.size(), 3);
+  auto pmapped = store.find(1, 64, 48);
+  BOOST_REQUIRE(pmapped);
+  BOOST_CHECK(equalPlanes(*pmapped, *pfirst));
+  BOOST_CHECK(equalPlanes(*store.find(2), *psecond));
+  BOOST_CHECK(equalPlanes(*store.find(1, 128, 96), *plarge));
+
+  // same key and size replaces the entry, frames of the old file keep their content
+  BOOST_REQUIRE(ReferenceStore::merge(fileName, { { 1, preplaced } }));
+  BOOST_CHECK(equalPlanes(*pmapped, *pfirst));
+  BOOST_REQUIRE(store.open(fileName));
+  BOOST_CHECK_EQUAL(store.size(), 3);
+  BOOST_CHECK(equalPlanes(*store.find(1, 64, 48), *preplaced));
+  BOOST_CHECK(equalPlanes(*store.find(2), *psecond));
+
+  store.close();
+  std::remove(fileName.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(invalid_files)
+{
+  ReferenceStore store;
+  BOOST_CHECK(!store.open("missing_store.wrs"));
+
+  std::string fileName = "reference_store_invalid.wrs";
+  BOOST_REQUIRE(ReferenceStore::write(fileName, { { 1, WR::createRandom(64, 64, 50, 1) } }));
+
+  // cut inside the planes
+  {
+    std::ifstream input(fileName, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    input.close();
+    std::ofstream output(fileName, std::ios::binary | std::ios::trunc);
+    output.write(content.data(), content.size() - 100);
+  }
+  BOOST_CHECK(!store.open(fileName));
+
+  {
+    std::ofstream output(fileName, std::ios::binary | std::ios::trunc);
+    output << "not a reference store";
+  }
+  BOOST_CHECK(!store.open(fileName));
+  BOOST_CHECK_EQUAL(store.size(), 0);
+  BOOST_CHECK(!ReferenceStore::merge(fileName, { { 1, WR::createRandom(64, 64, 50, 1) } }));
+
+  std::remove(fileName.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
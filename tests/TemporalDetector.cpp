@@ -0,0 +1,97 @@
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <random>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "Detector.h"
+#include "TemporalDetector.h"
+
+BOOST_AUTO_TEST_SUITE(temporal_detector);
+
+namespace
+{
+  // a moving gradient with noise standing in for a recompressed video, seeded
+  // by the index so the frames do not depend on earlier tests. The gradient
+  // moves far enough between frames that its chance correlation with the
+  // reference averages out over the window.
+  std::shared_ptr<VideoFrame> makeFrame(int width, int height, int index)
+  {
+    std::mt19937 generator(index);
+    auto pframe = std::make_shared<VideoFrame>(width, height, VideoFrame::Grayscale);
+    for (int i = 0; i < height; i++)
+      for (int j = 0; j < width; j++)
+        pframe->data(0)[i * pframe->stride(0) + j] = (uint8_t)(60 + 60 * std::sin((i + index * 37) * 0.03) + generator() % 128);
+    return pframe;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(accumulates_weak_evidence)
+{
+  int width = 160, height = 120;
+  auto preference = randomFrame(width, height, 50, 7, VideoFrame::Grayscale);
+  double threshold = 0.01;
+
+  TemporalDetector detector(preference, 32, threshold);
+  TemporalDetector detectorEmpty(preference, 32, threshold);
+
+  std::size_t detectedSingle = 0;
+  Detector::Result result = Detector::NO_WATERMARK;
+  for (int index = 0; index < 60; index++)
+  {
+    auto pframe = makeFrame(width, height, index);
+    auto pmarked = std::make_shared<VideoFrame>(*pframe);
+    pmarked->applyWR(preference, 0.05, true);
+
+    if (Detector::LinearCorrelation(pmarked, preference, threshold) == Detector::TRUE)
+      detectedSingle++;
+
+    result = detector.push(pmarked);
+    detectorEmpty.push(pframe);
+  }
+
+  // a single frame is too weak, the window is not
+  BOOST_CHECK(detectedSingle < 60);
+  BOOST_CHECK_EQUAL(result, Detector::TRUE);
+  BOOST_CHECK_EQUAL(detector.frames(), 32);
+  BOOST_CHECK(detector.correlation() > threshold);
+  BOOST_CHECK_EQUAL(detectorEmpty.result(), Detector::NO_WATERMARK);
+
+  detector.reset();
+  BOOST_CHECK_EQUAL(detector.frames(), 0);
+  BOOST_CHECK_EQUAL(detector.push(std::make_shared<VideoFrame>(width, height)), Detector::FAILED);
+  BOOST_CHECK_EQUAL(detector.frames(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(window_matches_recomputation)
+{
+  int width = 128, height = 96;
+  auto preference = randomFrame(width, height, 50, 7, VideoFrame::Grayscale);
+  std::size_t window = 5;
+  TemporalDetector detector(preference, window, 0.01);
+
+  std::vector<std::shared_ptr<VideoFrame>> frames;
+  for (int index = 0; index < 13; index++)
+  {
+    frames.push_back(makeFrame(width, height, index));
+    frames.back()->applyWR(preference, 0.2, index % 3 != 0);
+    detector.push(frames.back());
+
+    // pooled correlation of the last frames computed from scratch
+    double cross = 0, varianceF = 0, varianceN = 0;
+    for (std::size_t i = frames.size() - std::min(window, frames.size()); i < frames.size(); i++)
+    {
+      Detector::Moments moments;
+      Detector::computeMoments(frames[i], preference, moments);
+      double count = (double)moments.count;
+      cross += moments.sumFN[0] - (double)moments.sumF[0] * moments.sumN[0] / count;
+      varianceF += moments.sumFF[0] - (double)moments.sumF[0] * moments.sumF[0] / count;
+      varianceN += moments.sumNN[0] - (double)moments.sumN[0] * moments.sumN[0] / count;
+    }
+    BOOST_CHECK_CLOSE(detector.correlation(), cross / std::sqrt(varianceF) / std::sqrt(varianceN), 1e-6);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,118 @@
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.h"
+
+BOOST_AUTO_TEST_SUITE(thread_pool);
+
+BOOST_AUTO_TEST_CASE(parallel_for_covers_range)
+{
+  for (std::size_t threads : { 0, 1, 3, 8 })
+  {
+    ThreadPool threadPool(threads);
+    for (std::size_t grain : { 1, 7, 1000, 5000 })
+    {
+      std::vector<std::atomic<int>> visits(4321);
+      for (auto& visit : visits)
+        visit = 0;
+
+      // Boost.Test assertions are not thread safe, the workers only record violations
+      std::atomic<bool> oversized(false);
+      threadPool.parallel_for(10, visits.size(), grain, [&](std::size_t first, std::size_t last)
+      {
+        if (last - first > grain)
+          oversized = true;
+        for (std::size_t i = first; i < last; i++)
+          visits[i]++;
+      });
+
+      BOOST_REQUIRE(!oversized);
+      for (std::size_t i = 0; i < visits.size(); i++)
+        BOOST_REQUIRE_EQUAL(visits[i], i < 10 ? 0 : 1);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_inside_tasks)
+{
+  ThreadPool outer(4);
+  ThreadPool inner(3);
+  std::atomic<std::size_t> sum(0);
+
+  std::vector<std::future<void>> results;
+  for (int task = 0; task < 16; task++)
+  {
+    results.emplace_back(outer.enqueue([&]()
+    {
+      inner.parallel_for(0, 1000, 10, [&](std::size_t first, std::size_t last)
+      {
+        for (std::size_t i = first; i < last; i++)
+          sum += i;
+      });
+
+      outer.parallel_for(0, 100, 1, [&](std::size_t first, std::size_t last)
+      {
+        sum += last - first;
+      });
+    }));
+  }
+
+  for (auto&& result : results)
+    result.get();
+
+  BOOST_CHECK_EQUAL(sum, 16 * (999 * 1000 / 2 + 100));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for_exception_on_caller)
+{
+  ThreadPool threadPool(3);
+  std::thread::id caller = std::this_thread::get_id();
+
+  for (int repeat = 0; repeat < 20; repeat++)
+  {
+    std::atomic<std::size_t> chunks(0);
+    bool thrown = false;
+    try
+    {
+      threadPool.parallel_for(0, 10000, 1, [&](std::size_t, std::size_t)
+      {
+        chunks++;
+        if (std::this_thread::get_id() == caller)
+          throw std::runtime_error("chunk failed");
+        std::this_thread::yield();
+      });
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    BOOST_CHECK(thrown);
+    BOOST_CHECK(chunks <= 10000);
+
+    // the pool keeps working after the exception
+    std::atomic<std::size_t> sum(0);
+    threadPool.parallel_for(0, 1000, 10, [&](std::size_t first, std::size_t last)
+    {
+      for (std::size_t i = first; i < last; i++)
+        sum += i;
+    });
+    BOOST_CHECK_EQUAL(sum, 999 * 1000 / 2);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(enqueue_results)
+{
+  ThreadPool threadPool(4);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; i++)
+    results.emplace_back(threadPool.enqueue([](int value) { return value * 2; }, i));
+
+  for (int i = 0; i < 100; i++)
+    BOOST_CHECK_EQUAL(results[i].get(), i * 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
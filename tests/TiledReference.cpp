@@ -0,0 +1,84 @@
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+#include "Utils.h"
+#include "VideoFrame.h"
+#include "WatermarkReference.h"
+#include "TiledReference.h"
+#include "Detector.h"
+
+BOOST_AUTO_TEST_SUITE(tiled_reference);
+
+namespace
+{
+  std::shared_ptr<VideoFrame> crop(const VideoFrame& source, std::size_t width, std::size_t height)
+  {
+    auto pframe = std::make_shared<VideoFrame>(width, height, source.colorFormat());
+    for (std::size_t i = 0; i < height; i++)
+      std::copy_n(source.data(0) + i * source.stride(0), width * source.channels(), pframe->data(0) + i * pframe->stride(0));
+    return pframe;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(embed_matches_materialized)
+{
+  auto pframe = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg");
+  auto preference = std::make_shared<TiledReference>(WR::createRandom(64, 48, 50, 7));
+  BOOST_CHECK_EQUAL(preference->width(), 64);
+  BOOST_CHECK_EQUAL(preference->height(), 48);
+  BOOST_CHECK_EQUAL(preference->segmentBytes() % (64 * 3), 0);
+
+  auto pmaterialized = preference->materialize(pframe->width(), pframe->height());
+  BOOST_CHECK_EQUAL(pmaterialized->data(0)[(48 + 5) * pmaterialized->stride(0) + (64 * 2 + 3) * 3 + 1], preference->row(5)[3 * 3 + 1]);
+
+  VideoFrame expected(*pframe);
+  expected.applyWR(pmaterialized, 0.1, true, VideoFrame::C);
+
+  ThreadPool threadPool(3);
+  for (auto optimization : { VideoFrame::C, VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+  {
+    auto pmarked = std::make_shared<VideoFrame>(*pframe);
+    BOOST_REQUIRE(pmarked->applyWR(preference, 0.1, true, optimization));
+    BOOST_CHECK(equalPlanes(expected, *pmarked));
+
+    pmarked = std::make_shared<VideoFrame>(*pframe);
+    BOOST_REQUIRE(pmarked->applyWR(preference, 0.1, true, threadPool, optimization));
+    BOOST_CHECK(equalPlanes(expected, *pmarked));
+  }
+
+  auto pgray = std::make_shared<TiledReference>(WR::createRandom(64, 48, 50, 7, VideoFrame::Grayscale));
+  BOOST_CHECK(!pframe->applyWR(pgray, 0.1, true));
+}
+
+BOOST_AUTO_TEST_CASE(detect_any_resolution)
+{
+  auto psource = std::make_shared<VideoFrame>(getSourceDir(__FILE__) + "images/sea_640.jpg");
+  auto preference = std::make_shared<TiledReference>(WR::createRandom(128, 128, 50, 11));
+
+  // one tile serves frames of different sizes, including partial tiles
+  for (auto pframe : { psource, crop(*psource, 333, 251) })
+  {
+    auto pframeTrue = std::make_shared<VideoFrame>(*pframe);
+    auto pframeFalse = std::make_shared<VideoFrame>(*pframe);
+    pframeTrue->applyWR(preference, 0.1, true);
+    pframeFalse->applyWR(preference, 0.1, false);
+
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, 0.01), Detector::TRUE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeFalse, preference, 0.01), Detector::FALSE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframe, preference, 0.01), Detector::NO_WATERMARK);
+
+    // same exact moments as with the materialized reference
+    Detector::Moments moments;
+    BOOST_REQUIRE(Detector::computeMoments(pframeTrue, preference->materialize(pframe->width(), pframe->height()), moments));
+    double corr = Detector::correlation(moments);
+    ThreadPool threadPool(2);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, corr * 0.999999, threadPool), Detector::TRUE);
+    BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pframeTrue, preference, corr * 1.000001, threadPool), Detector::NO_WATERMARK);
+  }
+
+  auto pgray = std::make_shared<VideoFrame>(64, 48, VideoFrame::Grayscale);
+  BOOST_CHECK_EQUAL(Detector::LinearCorrelation(pgray, preference, 0.01), Detector::FAILED);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
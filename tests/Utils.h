@@ -1,8 +1,13 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <algorithm>
+#include <memory>
+#include <random>
 #include <string>
 
+#include "VideoFrame.h"
+
 inline std::string getSourceDir(const std::string &fileName)
 {
   std::size_t pos = fileName.find_last_of("\\/");
@@ -10,4 +15,37 @@ inline std::string getSourceDir(const std::string &fileName)
   return fileName.substr(0, pos + 1);
 }
 
+// Frame of values in [0, max) drawn from a generator seeded with `seed`, so
+// tests do not depend on the rand() state left behind by other tests
+inline std::shared_ptr<VideoFrame> randomFrame(std::size_t width, std::size_t height, int max, unsigned seed, VideoFrame::ColorFormat colorFormat = VideoFrame::Color)
+{
+  std::mt19937 generator(seed);
+  auto pframe = std::make_shared<VideoFrame>(width, height, colorFormat);
+  for (int plane = 0; plane < (int)pframe->planes(); plane++)
+  {
+    uint8_t* pdata = pframe->data(plane);
+    for (std::size_t i = 0; i < pframe->stride(plane) * pframe->planeHeight(plane); i++)
+      pdata[i] = (uint8_t)(generator() % max);
+  }
+  return pframe;
+}
+
+// Compares the visible bytes of every plane, row padding is ignored
+inline bool equalPlanes(const VideoFrame& a, const VideoFrame& b)
+{
+  if (a.width() != b.width() || a.height() != b.height() || a.colorFormat() != b.colorFormat())
+    return false;
+
+  for (int plane = 0; plane < (int)a.planes(); plane++)
+  {
+    std::size_t rowBytes = plane == 0 ? a.width() * a.channels() : (a.width() + 1) / 2 * (a.colorFormat() == VideoFrame::NV12 ? 2 : 1);
+    for (std::size_t i = 0; i < a.planeHeight(plane); i++)
+    {
+      if (!std::equal(a.data(plane) + i * a.stride(plane), a.data(plane) + i * a.stride(plane) + rowBytes, b.data(plane) + i * b.stride(plane)))
+        return false;
+    }
+  }
+  return true;
+}
+
 #endif
@@ -1,11 +1,16 @@
 #define BOOST_TEST_MODULE video_frame
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include "Utils.h"
 #include "VideoFrame.h"
 #include "WatermarkReference.h"
+#include "PreparedReference.h"
+#include "DCTKernels.h"
+#include "Detector.h"
 #include "ThreadPool.h"
 
 BOOST_AUTO_TEST_SUITE(video_frame);
@@ -51,7 +56,7 @@ BOOST_AUTO_TEST_CASE(pixel_data)
   BOOST_CHECK_EQUAL(frame.height(), height);
 
   uint8_t* pdata = frame.data(0);
-  int stride = width * 3;
+  std::size_t stride = frame.stride(0);
   for (int i = 0; i < height; i++)
   {
     for (int j = 0; j < width; j++)
@@ -80,22 +85,43 @@ BOOST_AUTO_TEST_CASE(pixel_data)
   BOOST_CHECK_EQUAL(g0, 0);
   BOOST_CHECK_EQUAL(b0, 0);
 
-  int b15 = pdata[15 * frameStored.width() * 3 + 15 * 3];
-  int g15 = pdata[15 * frameStored.width() * 3 + 15 * 3 + 1];
-  int r15 = pdata[15 * frameStored.width() * 3 + 15 * 3 + 2];
+  int b15 = pdata[15 * frameStored.stride(0) + 15 * 3];
+  int g15 = pdata[15 * frameStored.stride(0) + 15 * 3 + 1];
+  int r15 = pdata[15 * frameStored.stride(0) + 15 * 3 + 2];
 
   BOOST_CHECK_EQUAL(r15, 255);
   BOOST_CHECK_EQUAL(g15, 255);
   BOOST_CHECK_EQUAL(b15, 255);
 }
 
+BOOST_AUTO_TEST_CASE(aligned_planes)
+{
+  for (auto colorFormat : { VideoFrame::Color, VideoFrame::Grayscale })
+  {
+    for (std::size_t width : { 1, 63, 64, 100, 720 })
+    {
+      VideoFrame frame(width, 3, colorFormat);
+      std::size_t rowBytes = width * (colorFormat == VideoFrame::Color ? 3 : 1);
+
+      BOOST_CHECK_EQUAL((uintptr_t)frame.data(0) % 64, 0);
+      BOOST_CHECK_EQUAL(frame.stride(0) % 64, 0);
+      BOOST_CHECK(frame.stride(0) >= rowBytes);
+      BOOST_CHECK(frame.stride(0) < rowBytes + 64);
+
+      VideoFrame copy = frame;
+      BOOST_CHECK_EQUAL((uintptr_t)copy.data(0) % 64, 0);
+      BOOST_CHECK_EQUAL(copy.stride(0), frame.stride(0));
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE(applay_watermark_reference)
 {
   int width = 100, height = 200;
   VideoFrame frame(width, height);
 
   uint8_t* pdata = frame.data(0);
-  std::size_t stride = width * 3;
+  std::size_t stride = frame.stride(0);
   for (int i = 0; i < height; i++)
   {
     for (int j = 0; j < width; j++)
@@ -130,7 +156,7 @@ BOOST_AUTO_TEST_CASE(apply_wr_multithread)
   VideoFrame frame(width, height);
 
   uint8_t* pdata = frame.data(0);
-  std::size_t stride = width * 3;
+  std::size_t stride = frame.stride(0);
   for (int i = 0; i < height; i++)
   {
     for (int j = 0; j < width; j++)
@@ -143,6 +169,7 @@ BOOST_AUTO_TEST_CASE(apply_wr_multithread)
   }
 
   auto preference = WR::createRandom(width, height, 10);
+  VideoFrame frameOrig = frame;
   VideoFrame frameMT = frame;
   VideoFrame frameMTVert = frame;
 
@@ -160,6 +187,89 @@ BOOST_AUTO_TEST_CASE(apply_wr_multithread)
   pdataMT = frameMTVert.data(0);
   BOOST_CHECK_EQUAL_COLLECTIONS(pdata, pdata + size, pdataMT, pdataMT + size);
 
+  VideoFrame frameMTTiles = frameOrig;
+  frameMTTiles.applyWR(preference, 1.0, true, threadPool, VideoFrame::Auto, VideoFrame::Tiles);
+  pdataMT = frameMTTiles.data(0);
+  BOOST_CHECK_EQUAL_COLLECTIONS(pdata, pdata + size, pdataMT, pdataMT + size);
+
+}
+
+BOOST_AUTO_TEST_CASE(apply_wr_tiles)
+{
+  auto preference = WR::createRandom(3840, 270, 50);
+  auto pframe = WR::createRandom(3840, 270, 0xFF);
+
+  VideoFrame frame = *pframe;
+  frame.applyWR(preference, 0.5, false, VideoFrame::C);
+
+  for (std::size_t threads : { 1, 3, 16 })
+  {
+    ThreadPool threadPool(threads);
+    VideoFrame frameTiles = *pframe;
+    frameTiles.applyWR(preference, 0.5, false, threadPool, VideoFrame::Auto, VideoFrame::Tiles);
+
+    std::size_t size = frame.stride(0) * frame.height();
+    BOOST_CHECK_EQUAL_COLLECTIONS(frame.data(0), frame.data(0) + size, frameTiles.data(0), frameTiles.data(0) + size);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(apply_wr_tiles_empty)
+{
+  ThreadPool threadPool(3);
+  for (auto size : { std::make_pair(0, 16), std::make_pair(16, 0), std::make_pair(0, 0) })
+  {
+    auto preference = std::make_shared<VideoFrame>(size.first, size.second);
+    VideoFrame frame(size.first, size.second);
+    BOOST_CHECK(frame.applyWR(preference, 0.5, true, threadPool, VideoFrame::Auto, VideoFrame::Tiles));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(apply_wr_batch)
+{
+  int width = 320, height = 240;
+  auto preference = WR::createRandom(width, height, 10);
+  auto prepared = std::make_shared<PreparedReference>(preference, 2.0);
+  ThreadPool threadPool(4);
+
+  // fewer frames than threads splits frames into slices, more frames embeds whole frames
+  for (std::size_t count : { 1, 3, 17 })
+  {
+    std::vector<std::shared_ptr<VideoFrame>> frames;
+    std::vector<std::shared_ptr<VideoFrame>> framesPrepared;
+    std::vector<VideoFrame> expected;
+    std::vector<bool> bits;
+    for (std::size_t n = 0; n < count; n++)
+    {
+      auto pframe = std::make_shared<VideoFrame>(width, height);
+      uint8_t* pdata = pframe->data(0);
+      for (int i = 0; i < height; i++)
+        for (int j = 0; j < width * 3; j++)
+          pdata[i * pframe->stride(0) + j] = (uint8_t)(n * 7 + i + j);
+
+      frames.push_back(pframe);
+      framesPrepared.push_back(std::make_shared<VideoFrame>(*pframe));
+      bits.push_back(n % 2 == 0);
+      expected.push_back(*pframe);
+      expected.back().applyWR(preference, 2.0, bits.back());
+    }
+
+    BOOST_CHECK(VideoFrame::applyWRBatch(frames, preference, bits, 2.0, threadPool));
+    BOOST_CHECK(VideoFrame::applyWRBatch(framesPrepared, prepared, bits, threadPool));
+
+    std::size_t size = expected[0].stride(0) * height;
+    for (std::size_t n = 0; n < count; n++)
+    {
+      const uint8_t* pexpected = expected[n].data(0);
+      BOOST_CHECK_EQUAL_COLLECTIONS(pexpected, pexpected + size, frames[n]->data(0), frames[n]->data(0) + size);
+      BOOST_CHECK_EQUAL_COLLECTIONS(pexpected, pexpected + size, framesPrepared[n]->data(0), framesPrepared[n]->data(0) + size);
+    }
+  }
+
+  std::vector<std::shared_ptr<VideoFrame>> frames = { std::make_shared<VideoFrame>(width, height), std::make_shared<VideoFrame>(width, height / 2) };
+  std::vector<bool> bits = { true, false };
+  BOOST_CHECK(!VideoFrame::applyWRBatch(frames, preference, bits, 1.0, threadPool));
+  frames.pop_back();
+  BOOST_CHECK(!VideoFrame::applyWRBatch(frames, preference, bits, 1.0, threadPool));
 }
 
 BOOST_AUTO_TEST_CASE(apply_wr_sse)
@@ -176,7 +286,7 @@ BOOST_AUTO_TEST_CASE(apply_wr_sse)
 
   uint8_t *pdata = pframe->data(0);
   uint8_t* pdataSSE = pframeSSE->data(0);
-  std::size_t stride = width * 3;
+  std::size_t stride = pframe->stride(0);
   std::size_t size = stride * height;
 
   BOOST_CHECK_EQUAL_COLLECTIONS(pdata, pdata + size, pdataSSE, pdataSSE + size);
@@ -206,7 +316,7 @@ BOOST_AUTO_TEST_CASE(apply_wr_avx)
 
   uint8_t* pdata = pframe->data(0);
   uint8_t* pdataAVX = pframeAVX->data(0);
-  std::size_t stride = width * 3;
+  std::size_t stride = pframe->stride(0);
   std::size_t size = stride * height;
 
   BOOST_CHECK_EQUAL_COLLECTIONS(pdata, pdata + size, pdataAVX, pdataAVX + size);
@@ -223,6 +333,77 @@ BOOST_AUTO_TEST_CASE(apply_wr_avx)
   BOOST_CHECK_EQUAL_COLLECTIONS(pdata, pdata + size, pdataAVX, pdataAVX + size);
 }
 
+BOOST_AUTO_TEST_CASE(apply_wr_avx512)
+{
+  int width = 500, height = 350;
+
+  auto pframe = WR::createRandom(width, height, 0xFF);
+  auto pframeAVX512 = std::make_shared<VideoFrame>(*pframe);
+  auto preference = WR::createRandom(width, height, 10);
+
+  pframe->applyWR(preference, 1.0, true, VideoFrame::C);
+  pframeAVX512->applyWR(preference, 1.0, true, VideoFrame::AVX512);
+
+  uint8_t* pdata = pframe->data(0);
+  uint8_t* pdataAVX512 = pframeAVX512->data(0);
+  std::size_t stride = pframe->stride(0);
+  std::size_t size = stride * height;
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(pdata, pdata + size, pdataAVX512, pdataAVX512 + size);
+
+  pframe = WR::createRandom(width, height, 0xFF);
+  pframeAVX512 = std::make_shared<VideoFrame>(*pframe);
+
+  pframe->applyWR(preference, 1.0, false, VideoFrame::C);
+  pframeAVX512->applyWR(preference, 1.0, false, VideoFrame::AVX512);
+
+  pdata = pframe->data(0);
+  pdataAVX512 = pframeAVX512->data(0);
+
+  BOOST_CHECK_EQUAL_COLLECTIONS(pdata, pdata + size, pdataAVX512, pdataAVX512 + size);
+}
+
+BOOST_AUTO_TEST_CASE(apply_wr_alpha)
+{
+  int width = 501, height = 35;
+
+  auto pframe = WR::createRandom(width, height, 0xFF);
+  auto preference = WR::createRandom(width, height, 0xFF);
+  std::size_t size = pframe->stride(0) * height;
+
+  std::vector<VideoFrame::Optimization> optimizations = { VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512, VideoFrame::Auto };
+  std::vector<double> alphas = { 0.1, 0.5, 0.75, 1.0, 1.5, 3.0 };
+
+  for (double alpha : alphas)
+  {
+    for (bool key : { true, false })
+    {
+      VideoFrame frameC = *pframe;
+      frameC.applyWR(preference, alpha, key, VideoFrame::C);
+
+      uint8_t* pdataOrig = pframe->data(0);
+      uint8_t* pref = preference->data(0);
+      uint8_t* pdataC = frameC.data(0);
+      for (std::size_t i = 0; i < size; i++)
+      {
+        double gain = alpha > 1.0 ? alpha * alpha : alpha;
+        int expected = key ? pdataOrig[i] + (int)(pref[i] * gain) : pdataOrig[i] - (int)(pref[i] * gain);
+        expected = std::min(255, std::max(0, expected));
+        BOOST_CHECK(std::abs(expected - pdataC[i]) <= 1);
+      }
+
+      for (auto optimization : optimizations)
+      {
+        VideoFrame frame = *pframe;
+        frame.applyWR(preference, alpha, key, optimization);
+
+        uint8_t* pdata = frame.data(0);
+        BOOST_CHECK_EQUAL_COLLECTIONS(pdataC, pdataC + size, pdata, pdata + size);
+      }
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE(open_save_grayscale)
 {
   VideoFrame frame(getSourceDir(__FILE__) + "images/sea_640.jpg", VideoFrame::ColorFormat::Grayscale);
@@ -278,4 +459,257 @@ BOOST_AUTO_TEST_CASE(fdct_idct)
 
 }
 
+BOOST_AUTO_TEST_CASE(external_planes)
+{
+  const std::size_t width = 100, height = 30, stride = 320;
+  AlignedBuffer buffer(stride * height);
+  for (std::size_t i = 0; i < buffer.size(); i++)
+    buffer[i] = (uint8_t)(i * 7);
+
+  // the caller keeps the memory alive, no owner is needed
+  VideoFrame frame(width, height, VideoFrame::Color, { buffer.data() }, { stride }, nullptr);
+  BOOST_CHECK_EQUAL(frame.data(0), buffer.data());
+  BOOST_CHECK_EQUAL(frame.stride(0), stride);
+
+  VideoFrame copy(frame);
+  BOOST_CHECK(copy.data(0) != buffer.data());
+  BOOST_CHECK_EQUAL(copy.stride(0), alignedStride(width * 3));
+  for (std::size_t i = 0; i < height; i++)
+    BOOST_CHECK(std::equal(buffer.data() + i * stride, buffer.data() + i * stride + width * 3, copy.data(0) + i * copy.stride(0)));
+
+  BOOST_CHECK(frame.applyWR(WR::createRandom(width, height, 50, 1), 1.0, true));
+  BOOST_CHECK(!std::equal(buffer.data(), buffer.data() + width * 3, copy.data(0)));
+}
+
+BOOST_AUTO_TEST_CASE(dct_kernels)
+{
+  const double pi = 3.14159265358979323846;
+  const std::size_t count = 5;
+
+  std::vector<float> blocks(count * DCTKernels::blockFloats);
+  for (std::size_t i = 0; i < blocks.size(); i++)
+    blocks[i] = (float)(rand() % 256);
+
+  // direct evaluation of the orthonormal 2D DCT-II
+  std::vector<double> expected(blocks.size());
+  for (std::size_t b = 0; b < count; b++)
+  {
+    const float* pblock = blocks.data() + b * DCTKernels::blockFloats;
+    for (std::size_t u = 0; u < 8; u++)
+    {
+      for (std::size_t v = 0; v < 8; v++)
+      {
+        double sum = 0;
+        for (std::size_t y = 0; y < 8; y++)
+        {
+          for (std::size_t x = 0; x < 8; x++)
+            sum += pblock[y * 8 + x] * std::cos((2 * y + 1) * u * pi / 16) * std::cos((2 * x + 1) * v * pi / 16);
+        }
+        expected[b * DCTKernels::blockFloats + u * 8 + v] = sum * (u ? std::sqrt(0.25) : std::sqrt(0.125)) * (v ? std::sqrt(0.25) : std::sqrt(0.125));
+      }
+    }
+  }
+
+  std::vector<float> coefficientsC(blocks);
+  DCTKernels::forward(coefficientsC.data(), count, VideoFrame::C);
+  for (std::size_t i = 0; i < blocks.size(); i++)
+    BOOST_CHECK_SMALL(coefficientsC[i] - expected[i], 1e-3);
+
+  for (auto optimization : { VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+  {
+    std::vector<float> coefficients(blocks);
+    DCTKernels::forward(coefficients.data(), count, VideoFrame::resolveOptimization(optimization));
+    BOOST_CHECK_EQUAL_COLLECTIONS(coefficients.begin(), coefficients.end(), coefficientsC.begin(), coefficientsC.end());
+
+    DCTKernels::inverse(coefficients.data(), count, VideoFrame::resolveOptimization(optimization));
+    for (std::size_t i = 0; i < blocks.size(); i++)
+      BOOST_CHECK_SMALL(coefficients[i] - blocks[i], 1e-3f);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(dct_sharpening)
+{
+  auto preference = WR::createRandom(203, 131, 50, 17, VideoFrame::Grayscale);
+
+  VideoFrame expected(*preference);
+  srand(5);
+  expected.DCTSharpening(10, 50, VideoFrame::C);
+
+  // blocks past the last full 8x8 block stay as they were
+  BOOST_CHECK_EQUAL(expected.data(0)[130 * expected.stride(0) + 202], preference->data(0)[130 * preference->stride(0) + 202]);
+  BOOST_CHECK(*std::max_element(expected.data(0), expected.data(0) + expected.stride(0) * 128) <= 50);
+
+  std::size_t size = expected.stride(0) * expected.height();
+  for (auto optimization : { VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+  {
+    VideoFrame frame(*preference);
+    srand(5);
+    frame.DCTSharpening(10, 50, optimization);
+    BOOST_CHECK_EQUAL_COLLECTIONS(frame.data(0), frame.data(0) + size, expected.data(0), expected.data(0) + size);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(dct_sharpening_seeded)
+{
+  auto preference = WR::createRandom(517, 301, 50, 23, VideoFrame::Grayscale);
+
+  VideoFrame expected(*preference);
+  expected.DCTSharpening(10, 50, 77, VideoFrame::C);
+  BOOST_CHECK(*std::max_element(expected.data(0), expected.data(0) + expected.stride(0) * 296) <= 50);
+  BOOST_CHECK_EQUAL(expected.data(0)[300 * expected.stride(0) + 516], preference->data(0)[300 * preference->stride(0) + 516]);
+
+  // independent of rand(), the thread count and the instruction set
+  std::size_t size = expected.stride(0) * expected.height();
+  for (std::size_t threads : { 0, 1, 3, 7 })
+  {
+    ThreadPool threadPool(threads);
+    for (auto optimization : { VideoFrame::C, VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+    {
+      VideoFrame frame(*preference);
+      rand();
+      frame.DCTSharpening(10, 50, 77, threadPool, optimization);
+      BOOST_CHECK_EQUAL_COLLECTIONS(frame.data(0), frame.data(0) + size, expected.data(0), expected.data(0) + size);
+    }
+  }
+
+  VideoFrame other(*preference);
+  other.DCTSharpening(10, 50, 78);
+  BOOST_CHECK(!std::equal(other.data(0), other.data(0) + size, expected.data(0)));
+}
+
+BOOST_AUTO_TEST_CASE(yuv_planes)
+{
+  int width = 101, height = 51;
+  VideoFrame i420(width, height, VideoFrame::I420);
+  VideoFrame nv12(width, height, VideoFrame::NV12);
+
+  BOOST_CHECK_EQUAL(i420.planes(), 3);
+  BOOST_CHECK_EQUAL(nv12.planes(), 2);
+  BOOST_CHECK_EQUAL(i420.planeHeight(0), height);
+  BOOST_CHECK_EQUAL(i420.planeHeight(1), 26);
+  BOOST_CHECK(i420.stride(0) >= 101);
+  BOOST_CHECK(i420.stride(1) >= 51);
+  BOOST_CHECK(nv12.stride(1) >= 102);
+
+  for (int plane = 0; plane < 3; plane++)
+    BOOST_CHECK_EQUAL((uintptr_t)i420.data(plane) % 64, 0);
+
+  BOOST_CHECK(i420.data(1) != i420.data(0));
+  BOOST_CHECK_EQUAL(i420.data(1)[0], 128);
+  BOOST_CHECK_EQUAL(nv12.data(1)[1], 128);
+}
+
+BOOST_AUTO_TEST_CASE(yuv_open_save)
+{
+  VideoFrame i420(getSourceDir(__FILE__) + "images/sea_640.jpg", VideoFrame::I420);
+  VideoFrame nv12(getSourceDir(__FILE__) + "images/sea_640.jpg", VideoFrame::NV12);
+  BOOST_CHECK_EQUAL(i420.width(), 480);
+  BOOST_CHECK_EQUAL(i420.height(), 640);
+
+  for (std::size_t i = 0; i < i420.height(); i++)
+    BOOST_CHECK_EQUAL_COLLECTIONS(i420.data(0) + i * i420.stride(0), i420.data(0) + i * i420.stride(0) + i420.width(), nv12.data(0) + i * nv12.stride(0), nv12.data(0) + i * nv12.stride(0) + nv12.width());
+
+  for (std::size_t i = 0; i < i420.planeHeight(1); i++)
+  {
+    for (std::size_t j = 0; j < i420.width() / 2; j++)
+    {
+      BOOST_CHECK_EQUAL(i420.data(1)[i * i420.stride(1) + j], nv12.data(1)[i * nv12.stride(1) + j * 2]);
+      BOOST_CHECK_EQUAL(i420.data(2)[i * i420.stride(2) + j], nv12.data(1)[i * nv12.stride(1) + j * 2 + 1]);
+    }
+  }
+
+  i420.save(getSourceDir(__FILE__) + "out/open_save_i420.png");
+  VideoFrame stored(getSourceDir(__FILE__) + "out/open_save_i420.png", VideoFrame::I420);
+  BOOST_CHECK_EQUAL(stored.width(), 480);
+  BOOST_CHECK_EQUAL(stored.height(), 640);
+
+  int maxDiff = 0;
+  for (std::size_t i = 0; i < stored.height(); i++)
+  {
+    for (std::size_t j = 0; j < stored.width(); j++)
+      maxDiff = std::max(maxDiff, std::abs(stored.data(0)[i * stored.stride(0) + j] - i420.data(0)[i * i420.stride(0) + j]));
+  }
+  BOOST_CHECK(maxDiff <= 3);
+}
+
+BOOST_AUTO_TEST_CASE(yuv_open_odd_size)
+{
+  int width = 101, height = 51;
+  VideoFrame odd(width, height);
+  for (int i = 0; i < height; i++)
+    for (int j = 0; j < width * 3; j++)
+      odd.data(0)[i * odd.stride(0) + j] = (uint8_t)(128 + 60 * std::sin(i * 0.1 + j % 3) * std::cos(j / 3 * 0.07));
+  odd.save(getSourceDir(__FILE__) + "out/odd_size.png");
+
+  // odd sizes are kept, the chroma planes cover the last column and row
+  VideoFrame i420(getSourceDir(__FILE__) + "out/odd_size.png", VideoFrame::I420);
+  VideoFrame nv12(getSourceDir(__FILE__) + "out/odd_size.png", VideoFrame::NV12);
+  for (VideoFrame* pframe : { &i420, &nv12 })
+  {
+    BOOST_CHECK_EQUAL(pframe->width(), width);
+    BOOST_CHECK_EQUAL(pframe->height(), height);
+    BOOST_CHECK_EQUAL(pframe->planeHeight(1), 26);
+  }
+
+  for (int i = 0; i < height; i++)
+    BOOST_CHECK_EQUAL_COLLECTIONS(i420.data(0) + i * i420.stride(0), i420.data(0) + i * i420.stride(0) + width, nv12.data(0) + i * nv12.stride(0), nv12.data(0) + i * nv12.stride(0) + width);
+
+  for (std::size_t i = 0; i < i420.planeHeight(1); i++)
+  {
+    for (int j = 0; j < (width + 1) / 2; j++)
+    {
+      BOOST_CHECK_EQUAL(i420.data(1)[i * i420.stride(1) + j], nv12.data(1)[i * nv12.stride(1) + j * 2]);
+      BOOST_CHECK_EQUAL(i420.data(2)[i * i420.stride(2) + j], nv12.data(1)[i * nv12.stride(1) + j * 2 + 1]);
+    }
+  }
+
+  auto preference = WR::createRandom(width, height, 20, VideoFrame::Grayscale);
+  auto pmarked = std::make_shared<VideoFrame>(i420);
+  BOOST_CHECK(pmarked->applyWR(preference, 1.0, true));
+  BOOST_CHECK(Detector::LinearCorrelation(pmarked, preference, 0.01) != Detector::FAILED);
+
+  i420.save(getSourceDir(__FILE__) + "out/odd_size_i420.png");
+  VideoFrame stored(getSourceDir(__FILE__) + "out/odd_size_i420.png", VideoFrame::I420);
+  BOOST_CHECK_EQUAL(stored.width(), width);
+  BOOST_CHECK_EQUAL(stored.height(), height);
+
+  int maxDiff = 0;
+  for (int i = 0; i < height; i++)
+  {
+    for (int j = 0; j < width; j++)
+      maxDiff = std::max(maxDiff, std::abs(stored.data(0)[i * stored.stride(0) + j] - i420.data(0)[i * i420.stride(0) + j]));
+  }
+  BOOST_CHECK(maxDiff <= 3);
+}
+
+BOOST_AUTO_TEST_CASE(yuv_apply_wr_luma_only)
+{
+  int width = 320, height = 240;
+  auto preference = WR::createRandom(width, height, 20, VideoFrame::Grayscale);
+
+  for (auto colorFormat : { VideoFrame::I420, VideoFrame::NV12 })
+  {
+    VideoFrame frame(width, height, colorFormat);
+    for (std::size_t plane = 0; plane < frame.planes(); plane++)
+      std::fill(frame.data(plane), frame.data(plane) + frame.stride(plane) * frame.planeHeight(plane), 100);
+
+    VideoFrame frameOrig = frame;
+    BOOST_CHECK(frame.applyWR(preference, 1.0, true, VideoFrame::Auto));
+
+    for (int i = 0; i < height; i++)
+    {
+      for (int j = 0; j < width; j++)
+        BOOST_CHECK_EQUAL(frame.data(0)[i * frame.stride(0) + j], 100 + preference->data(0)[i * preference->stride(0) + j]);
+    }
+
+    for (std::size_t plane = 1; plane < frame.planes(); plane++)
+    {
+      std::size_t size = frame.stride(plane) * frame.planeHeight(plane);
+      BOOST_CHECK_EQUAL_COLLECTIONS(frame.data(plane), frame.data(plane) + size, frameOrig.data(plane), frameOrig.data(plane) + size);
+    }
+
+    BOOST_CHECK(!frame.applyWR(WR::createRandom(width, height, 20), 1.0, true));
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
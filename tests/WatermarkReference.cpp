@@ -1,8 +1,12 @@
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <vector>
+
 #include "Utils.h"
 #include "VideoFrame.h"
 #include "WatermarkReference.h"
+#include "GeneratorKernels.h"
 
 BOOST_AUTO_TEST_SUITE(watermark_reference);
 
@@ -16,7 +20,7 @@ BOOST_AUTO_TEST_CASE(create_random)
 
   uint8_t* pdata = preference->data(0);
 
-  int stride = (int)preference->width() * 3;
+  std::size_t stride = preference->stride(0);
   for (int i = 0; i < preference->height(); i++)
   {
     for (int j = 0; j < preference->width(); j++)
@@ -32,4 +36,74 @@ BOOST_AUTO_TEST_CASE(create_random)
   }
 }
 
+BOOST_AUTO_TEST_CASE(philox_known_answers)
+{
+  // test vectors published with the Random123 library
+  uint32_t result[4];
+  GeneratorKernels::philox({ 0, 0, 0, 0 }, 0, result);
+  BOOST_CHECK_EQUAL(result[0], 0x6627e8d5u);
+  BOOST_CHECK_EQUAL(result[1], 0xe169c58du);
+  BOOST_CHECK_EQUAL(result[2], 0xbc57ac4cu);
+  BOOST_CHECK_EQUAL(result[3], 0x9b00dbd8u);
+
+  GeneratorKernels::philox({ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, 0x299f31d0a4093822ull, result);
+  BOOST_CHECK_EQUAL(result[0], 0xd16cfe09u);
+  BOOST_CHECK_EQUAL(result[1], 0x94fdccebu);
+  BOOST_CHECK_EQUAL(result[2], 0x5001e420u);
+  BOOST_CHECK_EQUAL(result[3], 0x24126ea1u);
+}
+
+BOOST_AUTO_TEST_CASE(create_random_keyed)
+{
+  const std::size_t width = 333;
+  const std::size_t height = 77;
+  const uint64_t key = 0x0123456789abcdefull;
+
+  for (auto colorFormat : { VideoFrame::Color, VideoFrame::Grayscale })
+  {
+    auto preference = WR::createRandom(width, height, 50, key, colorFormat, VideoFrame::C);
+    std::size_t rowBytes = width * preference->channels();
+
+    std::size_t histogram[50] = {};
+    for (std::size_t i = 0; i < height; i++)
+    {
+      for (std::size_t j = 0; j < rowBytes; j++)
+      {
+        uint8_t value = preference->data(0)[i * preference->stride(0) + j];
+        BOOST_REQUIRE(value < 50);
+        histogram[value]++;
+      }
+    }
+    // every value occurs with roughly the same frequency
+    for (std::size_t count : histogram)
+      BOOST_CHECK(count > rowBytes * height / 50 / 2);
+
+    auto compare = [&](std::shared_ptr<VideoFrame> pother)
+    {
+      for (std::size_t i = 0; i < height; i++)
+        BOOST_REQUIRE(std::equal(preference->data(0) + i * preference->stride(0), preference->data(0) + i * preference->stride(0) + rowBytes, pother->data(0) + i * pother->stride(0)));
+    };
+
+    for (auto optimization : { VideoFrame::SSE, VideoFrame::AVX, VideoFrame::AVX512 })
+      compare(WR::createRandom(width, height, 50, key, colorFormat, optimization));
+
+    ThreadPool threadPool(3);
+    compare(WR::createRandom(width, height, 50, key, threadPool, colorFormat));
+
+    // any region can be generated on its own
+    const std::size_t x = 17, y = 5, regionWidth = 101, regionHeight = 9;
+    std::size_t regionBytes = regionWidth * preference->channels();
+    std::vector<uint8_t> region(regionBytes * regionHeight);
+    WR::generateRegion(region.data(), regionBytes, x, y, regionWidth, regionHeight, 50, key, colorFormat);
+    for (std::size_t i = 0; i < regionHeight; i++)
+    {
+      const uint8_t* prow = preference->data(0) + (y + i) * preference->stride(0) + x * preference->channels();
+      BOOST_REQUIRE(std::equal(prow, prow + regionBytes, region.data() + i * regionBytes));
+    }
+
+    auto pother = WR::createRandom(width, height, 50, key + 1, colorFormat);
+    BOOST_CHECK(!std::equal(preference->data(0), preference->data(0) + rowBytes, pother->data(0)));
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
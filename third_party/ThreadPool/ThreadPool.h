@@ -2,21 +2,36 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <algorithm>
+#include <cstdint>
 
 class ThreadPool {
 public:
     ThreadPool(size_t);
     template<class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) 
+    auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
+
+    // Calls fn(chunkBegin, chunkEnd) for consecutive chunks of at most `grain`
+    // items covering [begin, end). The calling thread takes part in the work and
+    // the call returns when every chunk is done. Chunks are split between the
+    // participants up front and idle participants steal half of the remaining
+    // chunks of a busy one; nothing is allocated per chunk.
+    // An exception of fn on the calling thread drops the chunks nobody started,
+    // waits for the running ones and is then rethrown. fn must not throw on the
+    // workers: there an exception calls std::terminate.
+    template<class F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F&& fn);
+
     std::size_t size() const
     {
       return workers.size();
@@ -24,48 +39,333 @@ public:
 
     ~ThreadPool();
 private:
+    // per-worker deque: the owner pushes and pops at the back, thieves take from the front
+    struct WorkQueue {
+        std::deque< std::function<void()> > tasks;
+        std::mutex mutex;
+    };
+
+    // state of one parallel_for call, lives on the caller's stack
+    struct RangeJob {
+        static const size_t localSlots = 64;
+
+        size_t begin;
+        size_t end;
+        size_t grain;
+        size_t chunks;
+        size_t slotsCount;
+        void* fn;
+        void (*invoke)(void*, size_t, size_t);
+
+        // [first, last) chunk indices of every participant packed into 32 bits each
+        std::atomic<uint64_t>* slots;
+        std::atomic<uint64_t> slotsStorage[localSlots];
+        std::unique_ptr< std::atomic<uint64_t>[] > slotsHeap;
+
+        std::atomic<size_t> nextSlot;
+        std::atomic<size_t> completed;
+        std::atomic<size_t> participants;
+        std::atomic<bool> exhausted;
+    };
+
+    static uint64_t packRange(uint64_t first, uint64_t last) { return (first << 32) | last; }
+    static size_t rangeFirst(uint64_t range) { return (size_t)(range >> 32); }
+    static size_t rangeLast(uint64_t range) { return (size_t)(range & 0xFFFFFFFFu); }
+
+    void workerLoop(size_t index);
+    bool popTask(size_t index, std::function<void()>& task);
+    bool runJob();
+    bool hasWork() const;
+    static void participate(RangeJob& job, size_t slot);
+    void finishJob(RangeJob& job);
+
+    // unregisters the job when parallel_for returns or unwinds
+    struct JobGuard {
+        ThreadPool& pool;
+        RangeJob& job;
+        ~JobGuard() { pool.finishJob(job); }
+    };
+    static bool claimChunk(RangeJob& job, size_t slot, size_t& chunk);
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
-    
+    std::vector< std::unique_ptr<WorkQueue> > queues;
+    std::vector< RangeJob* > jobs;
+
+    std::atomic<size_t> pending;
+    std::atomic<size_t> nextQueue;
+
     // synchronization
     std::mutex queue_mutex;
     std::condition_variable condition;
     bool stop;
+
+    // pool and worker index of the calling thread
+    static ThreadPool*& currentPool()
+    {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+    static size_t& currentWorker()
+    {
+        static thread_local size_t index = 0;
+        return index;
+    }
 };
- 
+
 // the constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(size_t threads)
-    :   stop(false)
+    :   pending(0), nextQueue(0), stop(false)
 {
+    jobs.reserve(16);
+    for(size_t i = 0;i<threads;++i)
+        queues.emplace_back(new WorkQueue);
     for(size_t i = 0;i<threads;++i)
-        workers.emplace_back(
-            [this]
+        workers.emplace_back([this, i] { workerLoop(i); });
+}
+
+inline void ThreadPool::workerLoop(size_t index)
+{
+    currentPool() = this;
+    currentWorker() = index;
+
+    for(;;)
+    {
+        if(runJob())
+            continue;
+
+        std::function<void()> task;
+        if(popTask(index, task))
+        {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        this->condition.wait(lock,
+            [this]{ return this->stop || hasWork(); });
+        if(this->stop && this->pending == 0)
+            return;
+    }
+}
+
+// called with queue_mutex held
+inline bool ThreadPool::hasWork() const
+{
+    if(pending > 0)
+        return true;
+    for(RangeJob* job : jobs)
+        if(!job->exhausted && job->nextSlot < job->slotsCount)
+            return true;
+    return false;
+}
+
+inline bool ThreadPool::popTask(size_t index, std::function<void()>& task)
+{
+    if(pending == 0)
+        return false;
+
+    {
+        WorkQueue& own = *queues[index];
+        std::unique_lock<std::mutex> lock(own.mutex);
+        if(!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --pending;
+            return true;
+        }
+    }
+
+    for(size_t i = 1; i < queues.size(); ++i)
+    {
+        WorkQueue& victim = *queues[(index + i) % queues.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool ThreadPool::runJob()
+{
+    RangeJob* job = nullptr;
+    size_t slot = 0;
+    {
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        for(RangeJob* candidate : jobs)
+        {
+            if(candidate->exhausted)
+                continue;
+            slot = candidate->nextSlot++;
+            if(slot < candidate->slotsCount)
             {
-                for(;;)
-                {
-                    std::function<void()> task;
-
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock,
-                            [this]{ return this->stop || !this->tasks.empty(); });
-                        if(this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-
-                    task();
-                }
+                job = candidate;
+                ++job->participants;
+                break;
             }
-        );
+        }
+    }
+
+    if(!job)
+        return false;
+
+    participate(*job, slot);
+    --job->participants;
+    return true;
+}
+
+inline bool ThreadPool::claimChunk(RangeJob& job, size_t slot, size_t& chunk)
+{
+    // take the next chunk of the own range
+    std::atomic<uint64_t>& own = job.slots[slot];
+    uint64_t range = own.load();
+    while(rangeFirst(range) < rangeLast(range))
+    {
+        if(own.compare_exchange_weak(range, packRange(rangeFirst(range) + 1, rangeLast(range))))
+        {
+            chunk = rangeFirst(range);
+            return true;
+        }
+    }
+
+    // own range is empty: steal the back half of the largest remaining range
+    for(;;)
+    {
+        size_t victim = job.slotsCount;
+        size_t victimSize = 0;
+        for(size_t i = 0; i < job.slotsCount; ++i)
+        {
+            uint64_t candidate = job.slots[i].load();
+            size_t candidateSize = rangeLast(candidate) > rangeFirst(candidate) ? rangeLast(candidate) - rangeFirst(candidate) : 0;
+            if(i != slot && candidateSize > victimSize)
+            {
+                victim = i;
+                victimSize = candidateSize;
+            }
+        }
+
+        if(victim == job.slotsCount)
+        {
+            job.exhausted = true;
+            return false;
+        }
+
+        range = job.slots[victim].load();
+        size_t first = rangeFirst(range);
+        size_t last = rangeLast(range);
+        if(first >= last)
+            continue;
+
+        size_t middle = last - (last - first + 1) / 2;
+        if(job.slots[victim].compare_exchange_strong(range, packRange(first, middle)))
+        {
+            // nobody else modifies an empty range, so it can be refilled without a CAS
+            chunk = middle;
+            own.store(packRange(middle + 1, last));
+            return true;
+        }
+    }
+}
+
+inline void ThreadPool::participate(RangeJob& job, size_t slot)
+{
+    size_t chunk = 0;
+    while(claimChunk(job, slot, chunk))
+    {
+        size_t chunkBegin = job.begin + chunk * job.grain;
+        size_t chunkEnd = std::min(job.end, chunkBegin + job.grain);
+        job.invoke(job.fn, chunkBegin, chunkEnd);
+        ++job.completed;
+    }
+}
+
+template<class F>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F&& fn)
+{
+    if(end <= begin)
+        return;
+
+    grain = std::max<size_t>(1, grain);
+    size_t chunks = (end - begin + grain - 1) / grain;
+    if(chunks >= 0xFFFFFFFFu)
+    {
+        grain = (end - begin + 0xFFFFFFFEu) / 0xFFFFFFFFu;
+        chunks = (end - begin + grain - 1) / grain;
+    }
+
+    using Fn = typename std::remove_reference<F>::type;
+    if(workers.empty() || chunks == 1)
+    {
+        for(size_t chunkBegin = begin; chunkBegin < end; chunkBegin += grain)
+            fn(chunkBegin, std::min(end, chunkBegin + grain));
+        return;
+    }
+
+    RangeJob job;
+    job.begin = begin;
+    job.end = end;
+    job.grain = grain;
+    job.chunks = chunks;
+    job.slotsCount = std::min(workers.size() + 1, chunks);
+    job.fn = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+    job.invoke = [](void* f, size_t b, size_t e) { (*static_cast<Fn*>(f))(b, e); };
+    job.slots = job.slotsStorage;
+    if(job.slotsCount > RangeJob::localSlots)
+    {
+        job.slotsHeap.reset(new std::atomic<uint64_t>[job.slotsCount]);
+        job.slots = job.slotsHeap.get();
+    }
+    for(size_t i = 0; i < job.slotsCount; ++i)
+        job.slots[i].store(packRange(chunks * i / job.slotsCount, chunks * (i + 1) / job.slotsCount));
+    job.nextSlot = 1;
+    job.completed = 0;
+    job.participants = 0;
+    job.exhausted = false;
+
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        jobs.push_back(&job);
+    }
+    condition.notify_all();
+
+    JobGuard guard{*this, job};
+    participate(job, 0);
+
+    while(job.completed < chunks)
+        std::this_thread::yield();
+}
+
+inline void ThreadPool::finishJob(RangeJob& job)
+{
+    // only an exception leaves chunks unfinished: empty every range so nobody
+    // starts another one. A thief may still refill its own range, it finishes
+    // that before it leaves the job.
+    if(job.completed < job.chunks)
+    {
+        for(size_t i = 0; i < job.slotsCount; ++i)
+            job.slots[i].store(packRange(0, 0));
+        job.exhausted = true;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+    }
+
+    while(job.participants > 0)
+        std::this_thread::yield();
 }
 
 // add new work item to the pool
 template<class F, class... Args>
-auto ThreadPool::enqueue(F&& f, Args&&... args) 
+auto ThreadPool::enqueue(F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type>
 {
     using return_type = typename std::result_of<F(Args...)>::type;
@@ -73,7 +373,7 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     auto task = std::make_shared< std::packaged_task<return_type()> >(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...)
         );
-        
+
     std::future<return_type> res = task->get_future();
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
@@ -82,7 +382,16 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
         if(stop)
             throw std::runtime_error("enqueue on stopped ThreadPool");
 
-        tasks.emplace([task](){ (*task)(); });
+        if(workers.empty())
+            throw std::runtime_error("enqueue on ThreadPool without workers");
+
+        // workers push to their own queue, other threads distribute round robin
+        size_t index = currentPool() == this ? currentWorker() : nextQueue++ % queues.size();
+        ++pending;
+        {
+            std::unique_lock<std::mutex> queueLock(queues[index]->mutex);
+            queues[index]->tasks.emplace_back([task](){ (*task)(); });
+        }
     }
     condition.notify_one();
     return res;